@@ -1,7 +1,7 @@
 #ifndef TEST_STRAT_H
 #define TEST_STRAT_H
 
-#define JOB_QUEUE_LENGTH 32
+#define JOB_QUEUE_LENGTH 256
 #define NUM_WORKERS 8
 #define NUM_CPUS 8
 
@@ -3,8 +3,6 @@
 
 #include "types.h"
 
-int MINUTES_PER_STEP;
-
 // Defined in basis points
 // $ charged = Gross * Fee points / 10 000
 extern int TRANSACTION_FEE;
@@ -13,19 +11,32 @@ extern int TRANSACTION_FEE;
  * Main execution loops
  */
 
+// Steps state until it has no orders left, skipping steps where every order is asleep
 void runScenario(struct SimState *state);
+// Steps state at most steps times, stopping early if it runs out of orders, without skipping idle steps
+void runScenarioSteps(struct SimState *state, long steps);
 void runScenarioDemo(struct SimState *state, int waitTimeMs);
 void graphScenario(struct SimState *state);
 
 void step(struct SimState *state);
+// Returns the time the next step will advance state to
+time_t nextStepTime(const struct SimState *state);
 
 /**
  * Single-Transaction helpers
  */
 
 void addPosition(struct SimState *state, union Symbol *symbol, int quantity);
+// Returns state's position in symbol, or NULL if it has none
+struct Position *findPosition(struct SimState *state, const union Symbol *symbol);
+// Returns state's first active custom order run by customFn, or NULL if it has none
+struct Order *findCustomOrder(struct SimState *state, OrderFn *customFn);
 struct Order *buy(struct SimState *state, union Symbol *symbol, int quantity);
 struct Order *sell(struct SimState *state, union Symbol *symbol, int quantity);
-struct Order *makeCustomOrder(struct SimState *state, union Symbol *symbol, int quantity, OrderFn *customFn);
+/**
+ * Adds a custom order, with auxBytes of zeroed aux storage from state's arena.
+ * Get at the storage with orderAux(state, order).
+ */
+struct Order *makeCustomOrder(struct SimState *state, union Symbol *symbol, int quantity, OrderFn *customFn, int auxBytes);
 
 #endif // ifndef EXECUTION_H
\ No newline at end of file
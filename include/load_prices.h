@@ -1,22 +1,86 @@
 #ifndef LOAD_PRICES_H
 #define LOAD_PRICES_H
 
+#include <stdio.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include "types.h"
+#include "price_codec.h"
 
+// Initial capacity, in rows, when reading a text price file
 #define PRICE_SERIES_LENGTH 8192
-#define PRICE_CACHE_ENTRIES 512
+
+// Binary price store: a PriceStoreHeader, followed by a column of `rows` time_t's,
+// then one column of `rows` longs for each BarField, in enum order.
+// Every column is padded out to a multiple of PRICE_COLUMN_ALIGNMENT bytes.
+#define PRICE_STORE_MAGIC "SSPRICE3"
+#define PRICE_COLUMN_ALIGNMENT 64
 
 /**
  * Structs
  */
 
+// Columns of a daily bar. Prices are in DOLLAR units, volume in shares.
+enum BarField {
+    BarOpen,
+    BarHigh,
+    BarLow,
+    BarClose,
+    BarVolume
+};
+#define NUM_BAR_FIELDS 5
+
+// A store is only used while its text file's modification time and size are still exactly those recorded here.
+struct PriceStoreHeader {
+    char magic[8];
+    long rows;
+    long textSeconds; // modification time of the text file it was made from
+    long textNanoseconds;
+    long textSize;
+    char padding[PRICE_COLUMN_ALIGNMENT - 8 - 4 * sizeof(long)];
+};
+_Static_assert( sizeof(struct PriceStoreHeader) == PRICE_COLUMN_ALIGNMENT, "PriceStoreHeader must keep columns aligned" );
+
+// Times, then each BarField, as compressed columns
+struct PackedPrices {
+    struct PackedColumn columns[NUM_BAR_FIELDS + 1];
+};
+
+// Full bar history for one symbol, as structure-of-arrays.
+// Shared by all threads, and never modified once loaded.
 struct Prices {
-    time_t times[PRICE_SERIES_LENGTH];
-    long prices[PRICE_SERIES_LENGTH];
+    // Point either into one aligned heap block, or into a mapped price store.
+    // NULL when the history is packed, in which case rows are decoded from packed.
+    time_t *times;
+    long *bars[NUM_BAR_FIELDS]; // indexed by BarField
     long validRows;
-    long lastUsage;
+    union Symbol symbol;
+    void *mapping;
+    size_t mappingLength;
+    struct PackedPrices *packed;
+};
+
+// Counters kept by each thread, and summed on demand by getHistoricalPriceStats
+enum PriceStat {
+    StatLookups,        // rows looked up, by any accessor
+    StatHits,           // lookups into already-loaded histories
+    StatMisses,         // lookups that had to load, or wait for another thread to load
+    StatLoads,          // histories loaded by this thread
+    StatLoadNanoseconds,
+    StatBytesParsed,    // text price data read
+    StatBytesMapped,    // binary price stores mapped
+    StatPrefetches,     // windows requested from the loader thread
+    StatPrefetchDrops,  // requests dropped because the loader's queue was full
+    StatBlockHits,      // packed lookups served by the decoded block cache
+    StatBlockMisses,    // packed blocks decoded
+    StatBlockEvictions  // decoded blocks replaced while still holding another block
+};
+#define NUM_PRICE_STATS 12
+
+// A symbol, and the span of time its price data covers
+struct SymbolPeriod {
+    time_t start, end;
     union Symbol symbol;
 };
 
@@ -26,9 +90,35 @@ struct Prices {
 
 /**
  * Returns the price stored in the price file, at the given time.
- * Automatically handles caching in an efficient, thread-safe way
+ * Symbol must be listed in the symbols file.
+ * Each symbol is loaded once, on first use, into memory shared by all threads.
+ * Safe to call from any thread after historicalPriceInit.
  */
 long getHistoricalPrice(const union Symbol *symbol, const time_t time);
+/**
+ * As getHistoricalPrice, but returns the given field of the bar in effect at time.
+ */
+long getHistoricalBarField(const union Symbol *symbol, const time_t time, enum BarField field);
+/**
+ * Returns the time of symbol's first bar after time, or 0 if there is none.
+ * Like getHistoricalPrice, never returns the last bar's time.
+ */
+time_t getNextHistoricalBarTime(const union Symbol *symbol, const time_t time);
+/**
+ * Stores every field of the bar in effect at time into bar, indexed by BarField.
+ */
+void getHistoricalBar(const union Symbol *symbol, const time_t time, long bar[NUM_BAR_FIELDS]);
+/**
+ * Computes the time-weighted mean and variance of symbol's price over [start, end),
+ * as if getHistoricalPrice were sampled continuously across it.
+ * Constant time, after a linear-time index is built on the symbol's first query.
+ */
+void getHistoricalPriceMoments(const union Symbol *symbol, time_t start, time_t end, double *mean, double *variance);
+/**
+ * Finds the lowest and highest price getHistoricalPrice returns for any time in [start, end).
+ * Logarithmic time, after a linear-time index is built on the symbol's first query.
+ */
+void getHistoricalPriceRange(const union Symbol *symbol, time_t start, time_t end, long *min, long *max);
 /**
  * Determines start/end times for historical pricing data for given symbol.
  * If no historical price data for symbol exists, returns 0.
@@ -41,6 +131,33 @@ long getHistoricalPriceTimePeriod(const union Symbol *symbol, time_t *start, tim
  * Do not call free on result of this function.
  */
 const union Symbol *getAllSymbols(int *n);
+/**
+ * Returns all symbols with their data periods, ordered by start of data, as a statically allocated array.
+ * If requiredDataStart is non-zero, writes to n the number of symbols whose data starts
+ * on or before it, which are exactly the first n. Otherwise writes the total to n.
+ * Do not call free on result of this function.
+ */
+const struct SymbolPeriod *getSymbolsByStart(time_t requiredDataStart, int *n);
+
+/**
+ * Sums every thread's counters, including threads that have exited, into totals.
+ * Safe to call from any thread, at any time.
+ */
+void getHistoricalPriceStats(unsigned long totals[NUM_PRICE_STATS]);
+/**
+ * Prints totals from getHistoricalPriceStats,
+ * and the symbols with the most misses along with their load times.
+ * Can be passed to atexit.
+ */
+void printHistoricalPriceStats(void);
+
+/**
+ * Opens symbol's binary price store for reading, first writing it from the text file if it's missing, stale, or unusable (truncated, or from another version).
+ * Returns the file descriptor, and stores the number of rows and the distance in rows between columns,
+ * or returns -1 if there's no usable store and no text file to write one from.
+ * Like loadHistoricalPrice, exits if the text file holds no price data.
+ */
+int openHistoricalPriceStore(const union Symbol *symbol, long *rows, long *stride);
 
 /**
  * Public Modifiers
@@ -51,18 +168,52 @@ const union Symbol *getAllSymbols(int *n);
  * prior to worker thread creation.
  */
 void historicalPriceInit();
-
 /**
- * This method needs to be called by the master thread
- * with the thread id of every thread that can call getHistoricalPrice
+ * If enabled is non-zero, each history is compressed once loaded,
+ * trading a little decode time per lookup for several times less memory.
+ * Only affects symbols loaded after the call.
  */
-void historicalPriceAddThread(pthread_t tid);
+void historicalPricePacking(int enabled);
+/**
+ * Starts loading each of the n symbols on the background loader threads,
+ * and faults in at least the rows of mapped histories covering start to end,
+ * so the first lookups in that window don't each wait on the disk in turn.
+ * Returns without waiting. Lookups on a symbol still being loaded wait for it.
+ * Loads some symbols itself if the loaders are already too far behind.
+ */
+void preloadHistoricalPrices(const union Symbol *symbols, int n, time_t start, time_t end);
 
 
 /**
  * Helpers
  */
 
-void loadHistoricalPrice(struct Prices *p, const time_t time);
+/**
+ * Loads the whole price history for p->symbol into p.
+ * Maps the binary store if there's an up-to-date one,
+ * otherwise parses the text file and writes a store beside it for next time.
+ */
+void loadHistoricalPrice(struct Prices *p);
+/**
+ * Parses a text price file from fp into newly allocated columns in p, up to the end of the stream.
+ * Returns the number of rows read, which are also left in p->validRows.
+ */
+long parseHistoricalPrice(struct Prices *p, FILE *fp);
+/**
+ * Maps the binary price store in filename. Unless text is NULL, only accepts a store made
+ * from a text file with exactly its modification time and size.
+ * Returns 1 and points p at the mapped columns on success, 0 otherwise.
+ */
+int mapHistoricalPrice(struct Prices *p, const char *filename, const struct stat *text);
+/**
+ * Writes p out as a binary price store, recording the modification time and size
+ * of the text file it was parsed from.
+ * Returns 1 on success, 0 (leaving no partial file behind) otherwise.
+ */
+int writeHistoricalPriceStore(const struct Prices *p, const char *filename, const struct stat *text);
+/**
+ * Replaces p's columns with a packed copy, releasing the originals.
+ */
+void packHistoricalPrice(struct Prices *p);
 
 #endif // ifndef LOAD_PRICES_H
\ No newline at end of file
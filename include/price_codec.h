@@ -0,0 +1,55 @@
+#ifndef PRICE_CODEC_H
+#define PRICE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Rows per independently decodable block
+#define PRICE_PACK_BLOCK_ROWS 128
+
+/**
+ * Structs
+ */
+
+// One column of a price series, compressed in blocks of PRICE_PACK_BLOCK_ROWS rows.
+// Each block keeps its first value as-is, followed by the zigzag-encoded differences
+// between consecutive values, bit-packed at the narrowest width that holds all of them.
+// Daily timestamps and fixed-point prices change by small amounts, so most blocks
+// pack into a handful of bits per row.
+struct PackedColumn {
+    long *firsts;          // first value of each block
+    long *offsets;         // index into words of each block's differences
+    unsigned char *widths; // bits per difference in each block
+    uint64_t *words;
+    long rows;
+};
+
+/**
+ * Public Accessors
+ */
+
+long packedColumnBlocks(const struct PackedColumn *column);
+/**
+ * Number of rows in the given block. Only the last block can be short.
+ */
+long packedBlockRows(const struct PackedColumn *column, long block);
+/**
+ * Decodes every row of block into values, which must have room for PRICE_PACK_BLOCK_ROWS.
+ */
+void unpackBlock(const struct PackedColumn *column, long block, long *values);
+/**
+ * Heap bytes used by column.
+ */
+size_t packedColumnBytes(const struct PackedColumn *column);
+
+/**
+ * Public Modifiers
+ */
+
+/**
+ * Compresses rows values into column, which owns the resulting storage.
+ */
+void packColumn(struct PackedColumn *column, const long *values, long rows);
+void freePackedColumn(struct PackedColumn *column);
+
+#endif // ifndef PRICE_CODEC_H
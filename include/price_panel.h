@@ -0,0 +1,75 @@
+#ifndef PRICE_PANEL_H
+#define PRICE_PANEL_H
+
+#include <time.h>
+
+#include "types.h"
+
+// Rows of the panel start on, and are padded out to, this many bytes
+#define PRICE_PANEL_ALIGNMENT 64
+// Largest panel worth building; beyond this, resampling costs more memory than it saves time
+#define PRICE_PANEL_MAX_BYTES (4L << 30)
+
+/**
+ * Structs
+ */
+
+// Historical prices for a fixed universe of symbols, resampled onto a fixed time grid.
+// Row k holds the price of every symbol at start + k * stepSize, forward-filled
+// exactly as getHistoricalPrice would report it, with one column per symbol.
+// Built once by the master thread, then shared read-only by all threads.
+struct PricePanel {
+    long *prices; // numSteps rows of rowStride longs, each row aligned
+    union Symbol *symbols; // symbol for each column
+    int *columnTable; // open-addressing table of column indices, keyed by symbol id. -1 marks an empty slot
+    int columnBits;
+    int numSymbols;
+    long rowStride;
+    long numSteps;
+    time_t start;
+    time_t stepSize;
+};
+
+/**
+ * Public Accessors
+ */
+
+/**
+ * Returns the row of prices at time, indexed by column,
+ * or NULL if time is not on the panel's grid.
+ */
+const long *pricePanelRow(const struct PricePanel *panel, const time_t time);
+/**
+ * Returns the column holding symbol, or -1 if symbol is not in the panel.
+ */
+int pricePanelColumn(const struct PricePanel *panel, const union Symbol *symbol);
+/**
+ * GetPriceFn adapter for the panel installed by usePricePanel.
+ * Reads the panel when symbol and time are on it, and otherwise
+ * falls back to getHistoricalPrice, so results never differ from it.
+ */
+long getPanelPrice(const union Symbol *symbol, const time_t time);
+/**
+ * Returns the number of bytes buildPricePanel would allocate for its prices,
+ * given the same arguments, as a double so that it can't overflow.
+ */
+double pricePanelBytes(int numSymbols, time_t start, time_t end, time_t stepSize);
+
+/**
+ * Public Modifiers
+ */
+
+/**
+ * Resamples the prices of numSymbols symbols onto the grid of times
+ * from start (rounded down to a multiple of stepSize) through end, stepSize apart.
+ * Needs historicalPriceInit to have been called.
+ */
+struct PricePanel *buildPricePanel(const union Symbol *symbols, int numSymbols, time_t start, time_t end, time_t stepSize);
+void freePricePanel(struct PricePanel *panel);
+/**
+ * Installs panel (or none, if NULL) for getPanelPrice.
+ * Call from the master thread, before worker threads start pricing.
+ */
+void usePricePanel(const struct PricePanel *panel);
+
+#endif // ifndef PRICE_PANEL_H
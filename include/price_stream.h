@@ -0,0 +1,72 @@
+#ifndef PRICE_STREAM_H
+#define PRICE_STREAM_H
+
+#include <time.h>
+#include <aio.h>
+
+#include "types.h"
+
+// Rows read from the price store at a time
+#define PRICE_STREAM_CHUNK_ROWS 2048
+// Each thread keeps up to half this many streams open, before closing them all and starting over
+#define PRICE_STREAM_TABLE_BITS 8
+
+/**
+ * Structs
+ */
+
+// A run of consecutive rows of one symbol's times and opening prices
+struct PriceChunk {
+    long firstRow;
+    long rows;
+    time_t times[PRICE_STREAM_CHUNK_ROWS];
+    long prices[PRICE_STREAM_CHUNK_ROWS];
+    struct aiocb reads[2]; // times, then prices
+    int pending;           // 1 while reads are in flight
+};
+
+// Replays one symbol's prices from its binary store, holding only two chunks at a time.
+// While lookups move forward through one chunk, the next is read in the background,
+// so memory stays constant however long the history is.
+// Owned by a single thread.
+struct PriceStream {
+    union Symbol symbol;
+    int fd;
+    long rows;   // rows that can be chosen; the store's last row never is, as with getHistoricalPrice
+    long stride; // rows between the starts of columns in the store
+    struct PriceChunk chunks[2];
+    int current; // index into chunks of the chunk being read from
+    long cursor; // row within the current chunk found last
+};
+
+/**
+ * Public Accessors
+ */
+
+/**
+ * Returns the opening price for symbol at time, as getHistoricalPrice does,
+ * from a stream kept by the calling thread. Can be used as a SimState's priceFn.
+ * Lookups are cheapest when each thread's times for a symbol mostly move forward.
+ */
+long getStreamedPrice(const union Symbol *symbol, const time_t time);
+/**
+ * Returns the opening price in stream s at time.
+ */
+long priceStreamPrice(struct PriceStream *s, const time_t time);
+
+/**
+ * Public Modifiers
+ */
+
+/**
+ * Opens a stream over symbol's prices. Exits if it has no price data.
+ */
+void openPriceStream(struct PriceStream *s, const union Symbol *symbol);
+void closePriceStream(struct PriceStream *s);
+/**
+ * Closes every stream opened by getStreamedPrice on the calling thread.
+ * Done automatically when the thread exits.
+ */
+void closeStreamedPrices(void);
+
+#endif // ifndef PRICE_STREAM_H
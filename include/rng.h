@@ -6,9 +6,24 @@
 /**
  * Thread-safe Random Number Generator.
  * Bootstraps up from rand_r, using a separate RNG state for each thread.
+ * Each thread's state lives in thread-local storage, seeded by tsRandInit or tsRandBindThread.
  */
 void tsRandInit(unsigned int seed);
-void tsRandAddThread(pthread_t tid);
+/**
+ * Draws a seed for a new thread from the calling thread's generator.
+ * Pass it to the thread through its start argument, for it to give to tsRandBindThread.
+ */
+unsigned int tsRandThreadSeed(void);
+/**
+ * Seeds the calling thread's generator. New threads should call this before anything else.
+ * Threads that never do get a seed of their own on first use, and a warning.
+ */
+void tsRandBindThread(unsigned int seed);
 int tsRand();
+/**
+ * Chooses n distinct indices in [0, count) uniformly at random, and writes them to chosen.
+ * Uses Floyd's algorithm, so makes exactly n calls to tsRand.
+ */
+void tsRandSample(int n, int count, int *chosen);
 
-#endif // ifndef RNG_H
\ No newline at end of file
+#endif // ifndef RNG_H
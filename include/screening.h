@@ -0,0 +1,65 @@
+#ifndef SCREENING_H
+#define SCREENING_H
+
+#include <time.h>
+
+#include "types.h"
+
+/**
+ * Structs
+ */
+
+enum ScreenStatistic {
+    ScreenMeanPrice,
+    ScreenVolatility // standard deviation divided by mean
+};
+
+struct ScreenedSymbol {
+    double value;
+    union Symbol symbol;
+};
+
+// One statistic, measured over history before the start of one day, for every symbol
+// with data covering that whole window, sorted by value.
+// Built on first use, then shared read-only by all threads until released by all of them.
+// Only the most recently used few in each bucket are kept after that.
+struct ScreeningDay {
+    enum ScreenStatistic statistic;
+    time_t history;
+    time_t day;
+    int n;
+    struct ScreenedSymbol *symbols;
+    // Guarded by the lock of the day's bucket
+    int users;
+    int built;
+    unsigned long lastUsed;
+    struct ScreeningDay *next;
+};
+
+/**
+ * Public Accessors
+ */
+
+/**
+ * Returns the index for statistic over history before the start of the day containing time,
+ * building it if no other thread has. Caller must release it with releaseScreeningDay.
+ */
+const struct ScreeningDay *getScreeningDay(enum ScreenStatistic statistic, time_t history, time_t time);
+/**
+ * Returns an array of n distinct symbols, chosen at random among those whose statistic
+ * is within +/- epsilon * target of target, measured over history before the day containing time.
+ * If fewer than n symbols qualify, returns the n symbols closest to target instead.
+ * Caller must free the result.
+ */
+union Symbol *screenSymbols(enum ScreenStatistic statistic, time_t history, time_t time, double target, double epsilon, int n);
+
+/**
+ * Public Modifiers
+ */
+
+/**
+ * Releases a day returned by getScreeningDay, which may then be freed.
+ */
+void releaseScreeningDay(const struct ScreeningDay *day);
+
+#endif // ifndef SCREENING_H
@@ -25,12 +25,12 @@ enum OrderStatus basicStrat1(struct SimState *state, struct Order *order);
 
 // Time-Horizon: Exit Strategy
 // Kills all orders, liquidates all positions at cutoff.
-// User must initialize order.aux to TimeHorizonArgs struct
+// User must initialize the order's aux to a TimeHorizonArgs struct
 struct TimeHorizonArgs {
     time_t offset;
     time_t cutoff;
 };
-BOUND_SIZE(struct TimeHorizonArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct TimeHorizonArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus timeHorizon(struct SimState *state, struct Order *order);
 
 /**
@@ -41,7 +41,7 @@ enum OrderStatus timeHorizon(struct SimState *state, struct Order *order);
 // Buys when price < buyFactor * EMA
 // Sell when price > sellFactor * EMA,
 //   or when price < stopFactor * boughtPrice
-// User should init order.aux to meanReversionArgs struct
+// User should init the order's aux to a MeanReversionArgs struct
 struct MeanReversionArgs {
     double emaDiscount; // new ema = (old ema) * discount + price * (1 - discount)
     double ema;         // initialize to 0, or price estimate
@@ -52,7 +52,7 @@ struct MeanReversionArgs {
     long boughtPrice;    // init to 0
     long boughtQuantity; // init to 0
 };
-BOUND_SIZE(struct MeanReversionArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct MeanReversionArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus meanReversion(struct SimState *state, struct Order *order);
 
 // Portfolio Rebalancing: Buy/Sell Strategy
@@ -67,7 +67,7 @@ struct PortfolioRebalanceArgs {
     long maxAssetValue;
     int symbolsUsed;
 };
-BOUND_SIZE(struct PortfolioRebalanceArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct PortfolioRebalanceArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus portfolioRebalance(struct SimState *state, struct Order *order);
 
 // Random-choice Portfolio Rebalancing: Buy/Sell Strategy
@@ -77,12 +77,14 @@ struct RandomPortfolioRebalanceArgs {
     long maxAssetValue;
     int numSymbols;
 };
-BOUND_SIZE(struct RandomPortfolioRebalanceArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct RandomPortfolioRebalanceArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus randomPortfolioRebalance(struct SimState *state, struct Order *order);
 
 // Volatility-chosen Portfolio Rebalancing: Buy/Sell Strategy
-// Starts by selecting random stocks with volatility within +/- epsilon of targetVolatility
-// Measures volatility over history length of time before now, sampling at sampleFrequency
+// Starts by selecting random stocks with volatility within +/- epsilon of targetVolatility,
+// or the stocks closest to it if too few qualify.
+// Measures volatility over history length of time before the start of today, time-weighted.
+// sampleFrequency is no longer used, and kept only for compatibility.
 struct VolatilityPortfolioRebalanceArgs {
     double targetVolatility;
     double epsilon;
@@ -91,12 +93,14 @@ struct VolatilityPortfolioRebalanceArgs {
     long maxAssetValue;
     int numSymbols;
 };
-BOUND_SIZE(struct VolatilityPortfolioRebalanceArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct VolatilityPortfolioRebalanceArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus volatilityPortfolioRebalance(struct SimState *state, struct Order *order);
 
 // Mean Price-chosen Portfolio Rebalancing: Buy/Sell Strategy
-// Starts by selecting random stocks with mean price within +/- epsilon of targetPrice
-// Measures mean price over history length of time before now, sampling at sampleFrequency
+// Starts by selecting random stocks with mean price within +/- epsilon of targetPrice,
+// or the stocks closest to it if too few qualify.
+// Measures mean price over history length of time before the start of today, time-weighted.
+// sampleFrequency is no longer used, and kept only for compatibility.
 struct MeanPricePortfolioRebalanceArgs {
     double targetPrice;
     double epsilon;
@@ -105,7 +109,7 @@ struct MeanPricePortfolioRebalanceArgs {
     long maxAssetValue;
     int numSymbols;
 };
-BOUND_SIZE(struct MeanPricePortfolioRebalanceArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct MeanPricePortfolioRebalanceArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus meanPricePortfolioRebalance(struct SimState *state, struct Order *order);
 
 // Buy-Balanced: Buy Strategy
@@ -117,7 +121,7 @@ struct BuyBalancedArgs {
     long totalValue;
     int symbolsUsed;
 };
-BOUND_SIZE(struct BuyBalancedArgs,ORDER_AUX_BYTES);
+BOUND_SIZE(struct BuyBalancedArgs,ORDER_AUX_ARENA_BYTES);
 enum OrderStatus buyBalanced(struct SimState *state, struct Order *order);
 
 /**
@@ -0,0 +1,78 @@
+#ifndef STRATEGY_SWEEP_H
+#define STRATEGY_SWEEP_H
+
+#include <time.h>
+
+#include "types.h"
+#include "strategies.h"
+#include "strategy_testing.h"
+
+// Each column of a sweep starts on, and is padded out to, this many bytes
+#define SWEEP_ALIGNMENT 64
+
+/**
+ * Structs
+ */
+
+// Many variants of one meanReversion order on one symbol, which differ only in their
+// MeanReversionArgs, laid out as structure-of-arrays so they can all be stepped together.
+// Every variant of a run sees the same prices at the same times, so each step reads
+// the price once, then updates all of them in flat loops over the columns.
+// Variant k of a run gives exactly the final cash of a SimState holding a timeHorizon order
+// with offset horizon, followed by a meanReversion order with args[k].
+// Every column holds doubles, so the loops vectorize without any 64-bit integer lanes;
+// samples, prices, quantities and cash are whole numbers in them, and stay exact.
+struct MeanReversionSweep {
+    union Symbol symbol;
+    time_t horizon;
+    int n; // variants
+    struct MeanReversionArgs *args; // each variant's args at the start of a run
+    // Columns, n entries each, in one aligned block
+    double *emaDiscount;
+    double *ema;
+    double *buyFactor;
+    double *sellFactor;
+    double *stopFactor;
+    double *initialSamples;
+    double *boughtPrice;
+    double *boughtQuantity;
+    double *cash;
+};
+
+/**
+ * Public Modifiers
+ */
+
+/**
+ * Sets up a sweep of the n variants in args, trading symbol, each liquidating horizon after its first step.
+ */
+struct MeanReversionSweep *makeMeanReversionSweep(const union Symbol *symbol, const struct MeanReversionArgs *args, int n, time_t horizon);
+void freeMeanReversionSweep(struct MeanReversionSweep *sweep);
+/**
+ * Runs every variant of sweep from state's time and cash, with its priceFn and step settings,
+ * leaving each one's final cash in sweep->cash. State's orders and positions are ignored.
+ * Advances state->time to the last step.
+ */
+void runMeanReversionSweep(struct MeanReversionSweep *sweep, struct SimState *state);
+
+/**
+ * Testing
+ */
+
+/**
+ * As randomizedStart, but runs every variant of sweep from each start time,
+ * with args->baseScenario supplying cash, prices and step settings, and args->dcs unused.
+ * Start times are shared out across NUM_WORKERS threads.
+ * Returns final cash variant-major: variant k's results for all args->n starts are at
+ * [k * args->n, (k + 1) * args->n), ready to pass to an OptimizerMetricSystem's metric.
+ * Caller must free the result.
+ */
+long *randomizedStartSweep(struct MeanReversionSweep *sweep, const struct RandomizedStartArgs *args);
+/**
+ * Runs sweep as randomizedStartSweep does, then runs every variant from every start time again
+ * as its own SimState through runScenario, and compares their final cash.
+ * Returns the number of runs where they differ, which should always be 0.
+ */
+long checkMeanReversionSweep(struct MeanReversionSweep *sweep, const struct RandomizedStartArgs *args);
+
+#endif // ifndef STRATEGY_SWEEP_H
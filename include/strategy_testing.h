@@ -8,6 +8,7 @@ struct RandomizedStartArgs {
     const struct DataCollectionSystem *dcs;
     time_t minStart;
     time_t maxStart;
+    time_t startGranularity; // if non-zero, start times are rounded down to a multiple of this
     int n;
 };
 
@@ -47,6 +48,28 @@ void **randomizedStartComparison(struct RandomizedStartArgs *args, int numScenar
  * Returns an array of the differences (changeScenario's result - baselineScenario's result) for each run.
  */
 long *randomizedStartDelta(struct RandomizedStartArgs *args, struct SimState *changeScenario, long **resultsEnd);
+/**
+ * As randomizedStartComparison, for numVariants scenarios which share their first warmUpSteps steps.
+ * Runs baseScenario for warmUpSteps steps from each start time just once, then forks each warmed-up state
+ * into every variant, calling vary(state, variant) to set the variant up before running it to the end.
+ * vary should only change what doesn't affect the warm-up, such as the factors a strategy
+ * only uses once its initial samples are taken, or the results will differ from unforked runs.
+ */
+void **randomizedStartForked(struct RandomizedStartArgs *args, long warmUpSteps, int numVariants,
+    void (*vary)(struct SimState *state, int variant), void ***resultEnds);
+/**
+ * Runs randomizedStartForked, then randomizedStartComparison on the same start times,
+ * with each variant set up by vary before it starts instead, and compares their final cash.
+ * Uses FinalCashDCS, whatever args->dcs is.
+ * Returns the number of results that differ, which should always be 0 if vary only changes what it should.
+ */
+long checkRandomizedStartForked(struct RandomizedStartArgs *args, long warmUpSteps, int numVariants,
+    void (*vary)(struct SimState *state, int variant));
+
+/**
+ * Chooses a random start time in the range given by args.
+ */
+time_t randomStartTime(const struct RandomizedStartArgs *args);
 
 /**
  * Optimization / Parameter Testing
@@ -31,9 +31,15 @@
 #define MAX_POSITIONS 128
 #define SYMBOL_LENGTH 8
 #define SYMBOL_ID_TYPE uint64_t
-#define ORDER_AUX_BYTES 4096
+#define ORDER_AUX_ARENA_BYTES 8192 // per state, shared by all its orders
+#define ORDER_AUX_ALIGNMENT 16
 #define SIMSTATE_AUX_BYTES 64
+#define POSITION_INDEX_BITS 8
+#define POSITION_INDEX_SIZE (1 << POSITION_INDEX_BITS)
+#define PRICE_MEMO_BITS 8
+#define PRICE_MEMO_SIZE (1 << PRICE_MEMO_BITS)
 _Static_assert( sizeof(SYMBOL_ID_TYPE) == SYMBOL_LENGTH * sizeof(char), "SYMBOL_ID_TYPE " STR(SYMBOL_ID_TYPE) " does not have the same size as " STR(SYMBOL_LENGTH) " chars" );
+_Static_assert( 2 * MAX_POSITIONS <= POSITION_INDEX_SIZE, "Position index must stay at most half full" );
 
 // Nominal time units for convenient use later on.
 extern const time_t SECOND;
@@ -43,6 +49,7 @@ extern const time_t DAY;
 extern const time_t WEEK;
 extern const time_t MONTH;
 extern const time_t YEAR;
+extern const time_t DEFAULT_STEP_SIZE;
 extern const long CENT;
 extern const long DOLLAR;
 
@@ -65,8 +72,16 @@ union Symbol {
 };
 
 // returns price. Use CENT and DOLLAR to convert to absolute value
+// Must always return the same price for the same symbol and time, since SimStates memoize it.
 typedef long (*GetPriceFn)(const union Symbol*, const time_t time);
 
+// A price looked up at time, kept so it's looked up once per step
+struct PriceMemoEntry {
+    union Symbol symbol;
+    time_t time;
+    long price;
+};
+
 // Orders
 
 enum OrderStatus {
@@ -83,12 +98,16 @@ enum OrderType {
 typedef enum OrderStatus OrderFn(struct SimState*, struct Order*);
 
 struct Order {
-    char aux[ORDER_AUX_BYTES];
+    int auxOffset; // into the owning state's orderAux
+    int auxSize;
     enum OrderStatus status;
     enum OrderType type;
     OrderFn *customFn;
     union Symbol symbol;
     int quantity;
+    // step() passes over the order before this time.
+    // A custom order sets it to sleep through steps where it would do nothing.
+    time_t wakeTime;
 };
 
 // Positions
@@ -109,6 +128,21 @@ struct SimState {
     int maxActiveOrder;
     int maxActivePosition;
     time_t time;
+    time_t stepSize; // how far each step advances time
+    // If set (non-zero id), each step advances to this symbol's next bar instead,
+    // falling back to stepSize once its data runs out
+    union Symbol stepSymbol;
+    // Position slot + 1 for each held symbol, open-addressed by symbol id; 0 if empty
+    unsigned char positionIndex[POSITION_INDEX_SIZE];
+    // Prices from priceMemoFn, open-addressed by symbol id.
+    // Entries for any time but state->time count as empty, so nothing need be cleared as time advances.
+    // Not copied by copySimState, which leaves the copy's memo to be cleared on first use.
+    GetPriceFn priceMemoFn;
+    struct PriceMemoEntry priceMemo[PRICE_MEMO_SIZE];
+    // Orders' aux storage, handed out in order by makeCustomOrder.
+    // Only the first orderAuxUsed bytes are meaningful, or copied.
+    int orderAuxUsed;
+    _Alignas(ORDER_AUX_ALIGNMENT) char orderAux[ORDER_AUX_ARENA_BYTES];
 };
 
 
@@ -132,6 +166,12 @@ void copySimState(struct SimState *dest, struct SimState *src);
  * Generic utilities
  */
 long worth(struct SimState *state);
+// Returns state->priceFn's price for symbol at state->time, looking it up at most once per time
+long statePrice(struct SimState *state, const union Symbol *symbol);
+// Returns the aux storage of order, which belongs to state
+static inline void *orderAux(struct SimState *state, const struct Order *order) {
+    return state->orderAux + order->auxOffset;
+}
 
 
 /**
@@ -10,6 +10,7 @@
 
 static struct JobQueue JOB_QUEUE;
 static int JOB_QUEUE_INITIALIZED = 0;
+static unsigned int WORKER_SEEDS[NUM_WORKERS];
 
 void initJobQueue(void) {
     if (JOB_QUEUE_INITIALIZED) return; // nothing to do!
@@ -32,15 +33,15 @@ void initJobQueue(void) {
     pthread_t thread;
     cpu_set_t cpu_set;
     for (int i = 0; i < NUM_WORKERS; ++i) {
-        if (pthread_create(&thread, NULL, runJobs, NULL)) {
+        // Seeded before it starts, so its draws never depend on thread timing
+        WORKER_SEEDS[i] = tsRandThreadSeed();
+        if (pthread_create(&thread, NULL, runJobs, WORKER_SEEDS + i)) {
             fprintf(stderr, "Error creating thread pool.\n");
             exit(1);
         }
         CPU_ZERO(&cpu_set);
         CPU_SET(i % NUM_CPUS, &cpu_set);
         pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpu_set);
-        tsRandAddThread(thread);
-        historicalPriceAddThread(thread);
     }
     JOB_QUEUE_INITIALIZED = 1;
 }
@@ -81,9 +82,8 @@ struct SimState *popJQState(struct JQStateQueue *queue) {
     return state;
 }
 
-// Add GCC unused attribute to stop GCC complaining
-// if I don't use this variable in the body.
-void *runJobs(__attribute__ ((unused)) void *dummy) {
+void *runJobs(void *seed) {
+    tsRandBindThread(*(unsigned int *)seed);
     struct SimState *scenario;
     while (1) {
         // Acquire next job
@@ -1,20 +1,51 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <pthread.h>
 
+#include "load_prices.h"
+
 #include "execution.h"
 
+#define POSITION_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+
 int TRANSACTION_FEE = 25;
-int MINUTES_PER_STEP = 12*60;
+
+/**
+ * Forward Declarations
+ */
+
+long positionIndexHome(SYMBOL_ID_TYPE id);
+long findPositionIndex(const struct SimState *state, SYMBOL_ID_TYPE id);
+void removePositionIndex(struct SimState *state, SYMBOL_ID_TYPE id);
+time_t nextWakeTime(const struct SimState *state);
 
 /**
  * Main execution loops
  */
 
 void runScenario(struct SimState *state) {
+    time_t wakeTime;
     while (state->maxActiveOrder) {
         step(state);
+        // Jump to the last step before any order wakes, since nothing happens until then
+        wakeTime = nextWakeTime(state);
+        if (wakeTime - 1 <= state->time) continue;
+        if (state->stepSymbol.id && getNextHistoricalBarTime(&state->stepSymbol, state->time)) {
+            // Any bars in between would be stepped over idly, so land on the first at or after wakeTime.
+            // If the bars run out first, step through the rest, so the steps after them stay on
+            // the same stepSize grid from the last bar as they would without skipping.
+            if (getNextHistoricalBarTime(&state->stepSymbol, wakeTime - 1)) state->time = wakeTime - 1;
+        } else if (wakeTime - state->time > state->stepSize) {
+            state->time += (wakeTime - state->time - 1) / state->stepSize * state->stepSize;
+        }
+    }
+}
+
+void runScenarioSteps(struct SimState *state, long steps) {
+    for (long i = 0; i < steps && state->maxActiveOrder; ++i) {
+        step(state);
     }
 }
 
@@ -55,13 +86,13 @@ void graphScenario(struct SimState *state) {
 }
 
 void step(struct SimState *state) {
-    state->time += (MINUTES_PER_STEP * 60);
+    state->time = nextStepTime(state);
     long transactionCost = 0;
     for (int i = 0; i < state->maxActiveOrder; ++i) {
-        if (state->orders[i].status == Active) {
+        if (state->orders[i].status == Active && state->orders[i].wakeTime <= state->time) {
             switch (state->orders[i].type) {
                 case Buy:
-                    transactionCost = state->orders[i].quantity * state->priceFn(&(state->orders[i].symbol), state->time);
+                    transactionCost = state->orders[i].quantity * statePrice(state, &(state->orders[i].symbol));
                     transactionCost += transactionCost * TRANSACTION_FEE / 10000;
                     if (state->cash >= transactionCost) {
                         state->cash -= transactionCost;
@@ -75,29 +106,24 @@ void step(struct SimState *state) {
                     }
                     break;
                 case Sell:
-                    {int j;
-                    for (j = 0; j < state->maxActivePosition; ++j) {
-                        if (state->positions[j].symbol.id == state->orders[i].symbol.id) {
-                            if (state->positions[j].quantity >= state->orders[i].quantity) {
-                                transactionCost = state->orders[i].quantity * state->priceFn(&(state->orders[i].symbol), state->time);
-                                transactionCost -= transactionCost * TRANSACTION_FEE / 10000;
-                                state->positions[j].quantity -= state->orders[i].quantity;
-                                state->cash += transactionCost;
-                                state->orders[i].status = None; // delete this order once it executes
-                            } else {
-                                db_printf("State time: %ld", state->time);
-                                printSimState(state);
-                                fprintf(stderr, "Sell Error - Insufficient shares: Have %.*s x %d, need %d\n", SYMBOL_LENGTH, state->positions[j].symbol.name, state->positions[j].quantity, state->orders[i].quantity);
-                                exit(1);
-                            }
-                            break;
-                        }
-                    }
-                    if (j >= state->maxActivePosition) {
+                    {struct Position *position = findPosition(state, &(state->orders[i].symbol));
+                    if (!position) {
                         db_printf("State time: %ld", state->time);
                         printSimState(state);
                         fprintf(stderr, "Sell Error - No position for sell order %.*s x %d\n", SYMBOL_LENGTH, state->orders[i].symbol.name, state->orders[i].quantity);
                         exit(1);
+                    }
+                    if (position->quantity >= state->orders[i].quantity) {
+                        transactionCost = state->orders[i].quantity * statePrice(state, &(state->orders[i].symbol));
+                        transactionCost -= transactionCost * TRANSACTION_FEE / 10000;
+                        position->quantity -= state->orders[i].quantity;
+                        state->cash += transactionCost;
+                        state->orders[i].status = None; // delete this order once it executes
+                    } else {
+                        db_printf("State time: %ld", state->time);
+                        printSimState(state);
+                        fprintf(stderr, "Sell Error - Insufficient shares: Have %.*s x %d, need %d\n", SYMBOL_LENGTH, position->symbol.name, position->quantity, state->orders[i].quantity);
+                        exit(1);
                     }}
                     break;
                 case Custom:
@@ -115,30 +141,57 @@ void step(struct SimState *state) {
            state->orders[state->maxActiveOrder - 1].status != Active) {
         --(state->maxActiveOrder);
     }
+    // Orders' aux storage is handed out in order, so the orders just dropped owned the end of it
+    state->orderAuxUsed = (state->maxActiveOrder ?
+        state->orders[state->maxActiveOrder - 1].auxOffset + state->orders[state->maxActiveOrder - 1].auxSize : 0);
     while (state->maxActivePosition > 0 && 
            state->positions[state->maxActivePosition - 1].quantity == 0) {
         --(state->maxActivePosition);
+        removePositionIndex(state, state->positions[state->maxActivePosition].symbol.id);
     }
 }
 
+time_t nextStepTime(const struct SimState *state) {
+    if (state->stepSymbol.id) {
+        const time_t barTime = getNextHistoricalBarTime(&state->stepSymbol, state->time);
+        if (barTime) return barTime;
+    }
+    return state->time + state->stepSize;
+}
+
 /**
  * Single-Transaction helpers
  */
 
 void addPosition(struct SimState *state, union Symbol *symbol, int quantity) {
-    int i;
-    for (i = 0; i < state->maxActivePosition; ++i) {
-        if (state->positions[i].symbol.id == symbol->id) break;
+    const long k = findPositionIndex(state, symbol->id);
+    if (state->positionIndex[k]) {
+        state->positions[state->positionIndex[k] - 1].quantity += quantity;
+        return;
     }
+    const int i = state->maxActivePosition;
     if (i >= MAX_POSITIONS) {
         fprintf(stderr, "No more positions available.\n");
         exit(1);
     }
-    state->positions[i].quantity += quantity;
-    if (i == state->maxActivePosition) {
-        ++(state->maxActivePosition);
-        state->positions[i].symbol = *symbol;
+    state->positions[i].quantity = quantity;
+    state->positions[i].symbol   = *symbol;
+    state->positionIndex[k] = (unsigned char)(i + 1);
+    ++(state->maxActivePosition);
+}
+
+struct Position *findPosition(struct SimState *state, const union Symbol *symbol) {
+    const long k = findPositionIndex(state, symbol->id);
+    return (state->positionIndex[k] ? state->positions + state->positionIndex[k] - 1 : NULL);
+}
+
+struct Order *findCustomOrder(struct SimState *state, OrderFn *customFn) {
+    for (int i = 0; i < state->maxActiveOrder; ++i) {
+        if (state->orders[i].status == Active && state->orders[i].type == Custom && state->orders[i].customFn == customFn) {
+            return state->orders + i;
+        }
     }
+    return NULL;
 }
 
 struct Order *buy(struct SimState *state, union Symbol *symbol, int quantity) {
@@ -151,6 +204,9 @@ struct Order *buy(struct SimState *state, union Symbol *symbol, int quantity) {
     state->orders[state->maxActiveOrder].symbol.id = symbol->id;
     state->orders[state->maxActiveOrder].quantity  = quantity;
     state->orders[state->maxActiveOrder].customFn  = NULL;
+    state->orders[state->maxActiveOrder].auxOffset = state->orderAuxUsed;
+    state->orders[state->maxActiveOrder].auxSize   = 0;
+    state->orders[state->maxActiveOrder].wakeTime  = 0;
     return state->orders + state->maxActiveOrder++;
 }
 
@@ -167,6 +223,9 @@ struct Order *sell(struct SimState *state, union Symbol *symbol, int quantity) {
     state->orders[state->maxActiveOrder].symbol.id = symbol->id;
     state->orders[state->maxActiveOrder].quantity  = quantity;
     state->orders[state->maxActiveOrder].customFn  = NULL;
+    state->orders[state->maxActiveOrder].auxOffset = state->orderAuxUsed;
+    state->orders[state->maxActiveOrder].auxSize   = 0;
+    state->orders[state->maxActiveOrder].wakeTime  = 0;
     return state->orders + state->maxActiveOrder++;
 }
 
@@ -174,16 +233,74 @@ struct Order *makeCustomOrder(
     struct SimState *state,
     union Symbol *symbol,
     int quantity,
-    OrderFn *customFn) {
+    OrderFn *customFn,
+    int auxBytes) {
 
     if (state->maxActiveOrder >= MAX_ORDERS) {
         fprintf(stderr, "No more orders available.\n");
         exit(1);
     }
+    int auxOffset = (state->orderAuxUsed + ORDER_AUX_ALIGNMENT - 1) / ORDER_AUX_ALIGNMENT * ORDER_AUX_ALIGNMENT;
+    if (auxOffset + auxBytes > ORDER_AUX_ARENA_BYTES) {
+        fprintf(stderr, "No more order aux storage available: need %d bytes, have %d.\n", auxBytes, ORDER_AUX_ARENA_BYTES - auxOffset);
+        exit(1);
+    }
+    memset(state->orderAux + auxOffset, 0, auxBytes);
+    state->orderAuxUsed = auxOffset + auxBytes;
+
     state->orders[state->maxActiveOrder].status    = Active;
     state->orders[state->maxActiveOrder].type      = Custom;
     state->orders[state->maxActiveOrder].symbol.id = (symbol ? symbol->id : 0);
     state->orders[state->maxActiveOrder].quantity  = quantity;
     state->orders[state->maxActiveOrder].customFn  = customFn;
+    state->orders[state->maxActiveOrder].auxOffset = auxOffset;
+    state->orders[state->maxActiveOrder].auxSize   = auxBytes;
+    state->orders[state->maxActiveOrder].wakeTime  = 0;
     return state->orders + state->maxActiveOrder++;
 }
+
+/**
+ * Helpers
+ */
+
+long positionIndexHome(SYMBOL_ID_TYPE id) {
+    return (long)((id * POSITION_HASH_MULTIPLIER) >> (64 - POSITION_INDEX_BITS));
+}
+
+// Returns the index entry holding id, or the empty entry where it would go
+long findPositionIndex(const struct SimState *state, SYMBOL_ID_TYPE id) {
+    const long mask = POSITION_INDEX_SIZE - 1;
+    long k = positionIndexHome(id);
+    while (state->positionIndex[k] && state->positions[state->positionIndex[k] - 1].symbol.id != id) {
+        k = (k + 1) & mask;
+    }
+    return k;
+}
+
+void removePositionIndex(struct SimState *state, SYMBOL_ID_TYPE id) {
+    const long mask = POSITION_INDEX_SIZE - 1;
+    long k = findPositionIndex(state, id);
+    if (!state->positionIndex[k]) return;
+    // Shift later entries of the run back into the gap, so no probe stops short of them
+    for (long j = (k + 1) & mask; state->positionIndex[j]; j = (j + 1) & mask) {
+        const long home = positionIndexHome(state->positions[state->positionIndex[j] - 1].symbol.id);
+        if (((j - home) & mask) >= ((j - k) & mask)) {
+            state->positionIndex[k] = state->positionIndex[j];
+            k = j;
+        }
+    }
+    state->positionIndex[k] = 0;
+}
+
+// Returns the earliest time any active order wakes
+time_t nextWakeTime(const struct SimState *state) {
+    if (!state->maxActiveOrder) return state->time;
+    // step() leaves the last order active
+    time_t wakeTime = state->orders[state->maxActiveOrder - 1].wakeTime;
+    for (int i = 0; i < state->maxActiveOrder; ++i) {
+        if (state->orders[i].status == Active && state->orders[i].wakeTime < wakeTime) {
+            wakeTime = state->orders[i].wakeTime;
+        }
+    }
+    return wakeTime;
+}
@@ -2,12 +2,41 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "load_prices.h"
 
+// Initial capacity of the time period cache, which grows as needed
 #define TIME_PERIOD_CACHE_SIZE 16384
-#define MAX_PC_THREADS 16
+#define SYMBOLS_SNAPSHOT_MAGIC "SSSYMBL2"
+#define PRICE_ARENA_LOCK_STRIPES 64
+#define PRICE_ARENA_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+#define PRICE_PREFETCH_QUEUE_LENGTH 256
+#define PRICE_LOADER_THREADS 4
+#define PAGE_BYTES 4096
+// Each thread keeps this many recently decoded blocks of packed series, direct-mapped
+#define DECODED_BLOCK_CACHE_BITS 5
+#define DECODED_BLOCK_CACHE_SIZE (1 << DECODED_BLOCK_CACHE_BITS)
+// Symbols listed by printHistoricalPriceStats
+#define PRICE_STATS_TOP_SYMBOLS 20
+
+// Report names for each PriceStat, in enum order
+static const char *PRICE_STAT_NAMES[NUM_PRICE_STATS] = {
+    "Lookups", "Hits", "Misses", "Loads", "Load time (ns)", "Bytes parsed", "Bytes mapped",
+    "Prefetch requests", "Prefetch drops", "Decoded block hits", "Decoded block misses", "Decoded block evictions"
+};
+
+// Text file column names for each BarField, in enum order
+static const char *BAR_FIELD_NAMES[NUM_BAR_FIELDS] = {
+    "Open", "High", "Low", "Close", "Volume"
+};
 
 // All available names for a data file, with %s indicating ticker symbol.
 // Names listed from most preferred to least
@@ -15,24 +44,109 @@ static const char *PRICE_FILENAME_FORMATS[] = {
     "resources/%s_daily_bars_san.csv"
 };
 static const int NUM_PRICE_FILENAME_FORMATS = sizeof(PRICE_FILENAME_FORMATS) / sizeof(*PRICE_FILENAME_FORMATS);
+// Binary price stores, as written by writeHistoricalPriceStore, either on first load or by stock-ingest
+// Preferred over all text formats when present.
+static const char *PRICE_STORE_FILENAME_FORMATS[] = {
+    "resources/%s_daily_bars.bin"
+};
+static const int NUM_PRICE_STORE_FILENAME_FORMATS = sizeof(PRICE_STORE_FILENAME_FORMATS) / sizeof(*PRICE_STORE_FILENAME_FORMATS);
+_Static_assert( sizeof(time_t) == sizeof(long), "Binary price store requires time_t and long to be the same size" );
+
+// One slot per symbol, in an open-addressing (linear probing) table keyed by symbol id.
+// The table is at most half full, so a lookup usually touches a single cache line.
+// Each symbol is loaded at most once, by whichever thread asks first,
+// and is immutable and read without locking from then on.
+struct PriceArenaSlot {
+    SYMBOL_ID_TYPE id; // 0 marks an empty slot
+    struct Prices *_Atomic prices;
+    time_t start, end;
+    // Bounds of the loaded history, valid once prices is set.
+    // Lookups outside them resolve to an edge row without searching.
+    time_t firstTime, lastTime;
+    long lastRow;
+    struct PriceAggregates *_Atomic aggregates; // built on the first window query
+    // Only touched on misses, so sharing them between threads is cheap
+    _Atomic long misses;
+    _Atomic long loadNanoseconds;
+};
+
+// One thread's counters. Only the owning thread writes them,
+// with plain loads and stores, so counting costs no locked instructions,
+// while other threads can still read them safely to sum them up.
+struct PriceStatsContext {
+    _Atomic unsigned long counts[NUM_PRICE_STATS];
+    int registered;
+    struct PriceStatsContext *prev, *next;
+};
 
-struct PriceCache {
-    struct Prices entries[PRICE_CACHE_ENTRIES];
-    long usageCounter;
-    pthread_t thread_id;
+// Window statistics over one symbol's opening prices, treating the price as
+// a step function of time that holds each row's value until the next row.
+// Prefix sums answer time-weighted means in constant time,
+// and segment trees answer min/max in logarithmic time.
+struct PriceAggregates {
+    double *weightedSums;       // weightedSums[r] = sum over rows i < r of price_i * (time_{i+1} - time_i)
+    double *weightedSquareSums; // as weightedSums, of price_i^2
+    long *minTree, *maxTree;    // node i covers nodes 2i and 2i+1, with row r's price at leaf rows + r
+    long rows;
 };
 
-struct TimePeriod {
+// Work for the background loader threads: load a slot, and fault in its window start to end.
+// Prefetching is only a hint, so requests are dropped when the queue is full.
+struct PrefetchRequest {
+    struct PriceArenaSlot *slot;
     time_t start, end;
-    union Symbol symbol;
-    struct TimePeriod *next;
 };
 
-static struct PriceCache **PRICE_CACHES = NULL;
-static struct TimePeriod TIME_PERIOD_CACHE[TIME_PERIOD_CACHE_SIZE];
+struct PrefetchQueue {
+    struct PrefetchRequest requests[PRICE_PREFETCH_QUEUE_LENGTH];
+    int front, back, size;
+    pthread_mutex_t lock;
+    pthread_cond_t nonEmpty;
+};
+
+// A block of a packed series, decoded one column at a time as it's needed.
+// Simulations move forward in time, so most lookups land in the block decoded last.
+struct DecodedBlock {
+    const struct Prices *prices;
+    long block;
+    unsigned int decodedColumns; // bit i set once columns[i] is valid
+    long columns[NUM_BAR_FIELDS + 1][PRICE_PACK_BLOCK_ROWS]; // times, then each BarField
+};
+
+// Binary snapshot of the symbols file: a SymbolsSnapshotHeader, then `count` SymbolPeriods
+// ordered by symbol id, the same ordered by start, and `count` Symbols ordered by id.
+// Mapped at startup instead of parsing and sorting the text file,
+// as long as that file's modification time and size are still exactly those recorded here.
+struct SymbolsSnapshotHeader {
+    char magic[8];
+    long count;
+    long textSeconds; // modification time of the symbols file it was made from
+    long textNanoseconds;
+    long textSize;
+    char padding[PRICE_COLUMN_ALIGNMENT - 8 - 4 * sizeof(long)];
+};
+
+static struct PriceArenaSlot *PRICE_ARENA = NULL;
+static int PRICE_ARENA_BITS = 0;
+// First loads of slots sharing a stripe are serialized
+static pthread_mutex_t PRICE_ARENA_LOCKS[PRICE_ARENA_LOCK_STRIPES];
+static struct PrefetchQueue PREFETCH_QUEUE;
+static int PACK_PRICES = 0;
+static _Thread_local struct DecodedBlock DECODED_BLOCKS[DECODED_BLOCK_CACHE_SIZE];
+static _Thread_local struct PriceStatsContext PRICE_STATS;
+// Live threads' counters, and the sum of counters from threads that have exited
+static struct PriceStatsContext *PRICE_STATS_THREADS = NULL;
+static unsigned long RETIRED_PRICE_STATS[NUM_PRICE_STATS];
+static pthread_mutex_t PRICE_STATS_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t PRICE_STATS_KEY;
+static pthread_once_t PRICE_STATS_KEY_ONCE = PTHREAD_ONCE_INIT;
+// Sorted by symbol id
+static struct SymbolPeriod *TIME_PERIOD_CACHE = NULL;
 static int TPC_MAX_USED = 0;
 static const char *ALL_SYMBOLS_FILE = "resources/symbols.txt";
-static union Symbol ALL_SYMBOLS[TIME_PERIOD_CACHE_SIZE];
+static const char *ALL_SYMBOLS_SNAPSHOT_FILE = "resources/symbols.bin";
+static union Symbol *ALL_SYMBOLS = NULL;
+static struct SymbolPeriod *SYMBOLS_BY_START = NULL;
 
 /**
  * Forward Declarations
@@ -40,44 +154,108 @@ static union Symbol ALL_SYMBOLS[TIME_PERIOD_CACHE_SIZE];
 
 void initializeTimePeriodCache(void);
 void quicksortTPC(int start, int end);
-long getPriceFromCache(const union Symbol *symbol, const time_t time, struct PriceCache *priceCache);
+int mapSymbolsSnapshot(const char *filename, const struct stat *text);
+int writeSymbolsSnapshot(const char *filename, const struct stat *text);
+int compareSymbolPeriods(const void *a, const void *b);
+struct PriceArenaSlot *findArenaSlot(const union Symbol *symbol);
+struct Prices *loadArenaSlot(struct PriceArenaSlot *slot);
+int findPriceFile(const char **formats, int numFormats, const char *symbolName, char *buf, int bufSize, struct stat *st);
+void inProgressName(char *buf, int bufSize, const char *filename);
+int checkPriceStoreHeader(const struct PriceStoreHeader *header, off_t size, const char *filename);
+int priceStoreMatchesText(const struct PriceStoreHeader *header, const struct stat *text, const char *filename);
+const struct Prices *findHistoricalRow(const union Symbol *symbol, const time_t time, long *row);
+long findPackedRow(const struct Prices *p, const time_t time);
+long lastAtOrBefore(const long *values, long n, long target);
+long historicalBarValue(const struct Prices *p, enum BarField field, long row);
+const long *decodedColumn(const struct Prices *p, long block, int column);
+time_t historicalTime(const struct Prices *p, long row);
+const struct PriceAggregates *findAggregates(const union Symbol *symbol);
+struct PriceAggregates *buildAggregates(const struct Prices *p);
+double weightedIntegral(const union Symbol *symbol, const double *sums, time_t time, int squared);
+long columnStride(long rows);
+void allocatePriceColumns(struct Prices *p, long capacity);
+int queuePriceRequest(struct PriceArenaSlot *slot, time_t start, time_t end);
+void *runPriceLoader(void *);
+void countPriceStat(enum PriceStat stat, unsigned long amount);
+void createPriceStatsKey(void);
+void retirePriceStats(void *context);
+int compareSlotMisses(const void *a, const void *b);
 
 /**
  * Initializers & Modifiers
  */
 
 void historicalPriceInit() {
-    if (PRICE_CACHES) return;
+    if (PRICE_ARENA) return;
 
-    PRICE_CACHES = malloc(sizeof(*PRICE_CACHES) * MAX_PC_THREADS);
+    initializeTimePeriodCache();
 
-    for (int i = 0; i < MAX_PC_THREADS; ++i) {
-        PRICE_CACHES[i] = NULL;
+    // Size the table to at least twice the number of symbols
+    for (PRICE_ARENA_BITS = 1; (1L << PRICE_ARENA_BITS) < 2L * TPC_MAX_USED; ++PRICE_ARENA_BITS) ;
+    long arenaSize = 1L << PRICE_ARENA_BITS;
+    PRICE_ARENA = malloc(sizeof(*PRICE_ARENA) * arenaSize);
+    for (long i = 0; i < arenaSize; ++i) {
+        PRICE_ARENA[i].id = 0;
+        atomic_init(&PRICE_ARENA[i].prices, NULL);
+        atomic_init(&PRICE_ARENA[i].aggregates, NULL);
+        atomic_init(&PRICE_ARENA[i].misses, 0);
+        atomic_init(&PRICE_ARENA[i].loadNanoseconds, 0);
+    }
+    for (int i = 0; i < PRICE_ARENA_LOCK_STRIPES; ++i) {
+        pthread_mutex_init(PRICE_ARENA_LOCKS + i, NULL);
     }
-    initializeTimePeriodCache();
-}
 
-void initializePriceCache(struct PriceCache *priceCache) {
-    for (long i = 0; i < PRICE_CACHE_ENTRIES; ++i) {
-        priceCache->entries[i].symbol.id = 0;
+    long mask = arenaSize - 1;
+    long j;
+    for (int i = 0; i < TPC_MAX_USED; ++i) {
+        j = (long)((TIME_PERIOD_CACHE[i].symbol.id * PRICE_ARENA_HASH_MULTIPLIER) >> (64 - PRICE_ARENA_BITS));
+        while (PRICE_ARENA[j].id) j = (j + 1) & mask;
+        PRICE_ARENA[j].id    = TIME_PERIOD_CACHE[i].symbol.id;
+        PRICE_ARENA[j].start = TIME_PERIOD_CACHE[i].start;
+        PRICE_ARENA[j].end   = TIME_PERIOD_CACHE[i].end;
+    }
+
+    PREFETCH_QUEUE.front = PREFETCH_QUEUE.back = PREFETCH_QUEUE.size = 0;
+    pthread_mutex_init(&PREFETCH_QUEUE.lock, NULL);
+    pthread_cond_init(&PREFETCH_QUEUE.nonEmpty, NULL);
+    pthread_t loader;
+    for (int i = 0; i < PRICE_LOADER_THREADS; ++i) {
+        if (pthread_create(&loader, NULL, runPriceLoader, NULL)) {
+            fprintf(stderr, "Error creating price loader thread.\n");
+            exit(1);
+        }
+        pthread_detach(loader);
     }
-    priceCache->usageCounter = 0;
 }
 
-void historicalPriceAddThread(pthread_t tid) {
-    int i;
-    for (i = 0; i < MAX_PC_THREADS && PRICE_CACHES[i]; ++i) ;
-    if (i >= MAX_PC_THREADS) {
-        fprintf(stderr, "Max number of price caches exceeded\n");
-        exit(1);
+void preloadHistoricalPrices(const union Symbol *symbols, int n, time_t start, time_t end) {
+    struct PriceArenaSlot *slot;
+    struct Prices *p;
+    for (int i = 0; i < n; ++i) {
+        slot = findArenaSlot(symbols + i);
+        if (!slot) continue; // reported by the first lookup instead
+        p = atomic_load_explicit(&slot->prices, memory_order_acquire);
+        if (p && !p->mapping) continue; // heap-backed series are already resident
+        countPriceStat(StatPrefetches, 1);
+        if (!queuePriceRequest(slot, start, end) && !p) {
+            // The loaders are behind, so share the work rather than queueing more
+            loadArenaSlot(slot);
+        }
     }
+}
 
-    PRICE_CACHES[i] = malloc(sizeof(*PRICE_CACHES[i]));
-    initializePriceCache(PRICE_CACHES[i]);
-    PRICE_CACHES[i]->thread_id = tid;
+void historicalPricePacking(int enabled) {
+    PACK_PRICES = enabled;
 }
 
 void initializeTimePeriodCache(void) {
+    // A snapshot of any other version of the symbols file is stale, and gets rebuilt below
+    struct stat textStat;
+    int haveText = !stat(ALL_SYMBOLS_FILE, &textStat);
+    if (mapSymbolsSnapshot(ALL_SYMBOLS_SNAPSHOT_FILE, haveText ? &textStat : NULL)) {
+        return;
+    }
+
     const int bufSize = 256;
     char buf[bufSize];
     memset(buf, 0, bufSize * sizeof(char));
@@ -92,9 +270,12 @@ void initializeTimePeriodCache(void) {
         exit(1);
     }
 
+    int capacity = TIME_PERIOD_CACHE_SIZE;
+    TIME_PERIOD_CACHE = malloc(sizeof(*TIME_PERIOD_CACHE) * capacity);
+
     // Read in column headers
-    while (fgets(buf, bufSize, fp) &&
-           (symbolCol < 0 || startCol < 0 || endCol < 0)) {
+    while ((symbolCol < 0 || startCol < 0 || endCol < 0) &&
+           fgets(buf, bufSize, fp)) {
         col = 0;
         for (back = buf; *back; back = front + 1) {
             for (front = back; *front && *front != ',' && *front != '\n'; ++front) ;
@@ -112,6 +293,10 @@ void initializeTimePeriodCache(void) {
 
     // Read in data
     while (fgets(buf, bufSize, fp)) {
+        if (TPC_MAX_USED >= capacity) {
+            capacity *= 2;
+            TIME_PERIOD_CACHE = realloc(TIME_PERIOD_CACHE, sizeof(*TIME_PERIOD_CACHE) * capacity);
+        }
         col = 0;
         for (back = buf; *back; back = front + 1) {
             for (front = back; *front && *front != ','; ++front) ;
@@ -126,10 +311,6 @@ void initializeTimePeriodCache(void) {
             ++col;
         }
         ++TPC_MAX_USED;
-        if (TPC_MAX_USED >= TIME_PERIOD_CACHE_SIZE) {
-            fprintf(stderr, "Exceeded maximum size of time period cache\n");
-            exit(1);
-        }
     }
 
     fclose(fp);
@@ -137,10 +318,97 @@ void initializeTimePeriodCache(void) {
     // Do an in-place quicksort of symbols
     quicksortTPC(0, TPC_MAX_USED - 1);
 
-    // Load the all-symbols array
+    // Load the all-symbols array, and the same symbols ordered by start of data
+    ALL_SYMBOLS      = malloc(sizeof(*ALL_SYMBOLS) * (TPC_MAX_USED ? TPC_MAX_USED : 1));
+    SYMBOLS_BY_START = malloc(sizeof(*SYMBOLS_BY_START) * (TPC_MAX_USED ? TPC_MAX_USED : 1));
     for (int i = 0; i < TPC_MAX_USED; ++i) {
-        ALL_SYMBOLS[i].id = TIME_PERIOD_CACHE[i].symbol.id;
+        ALL_SYMBOLS[i].id   = TIME_PERIOD_CACHE[i].symbol.id;
+        SYMBOLS_BY_START[i] = TIME_PERIOD_CACHE[i];
     }
+    qsort(SYMBOLS_BY_START, TPC_MAX_USED, sizeof(*SYMBOLS_BY_START), compareSymbolPeriods);
+
+    // Leave a snapshot behind, so later runs can map this instead of parsing it
+    writeSymbolsSnapshot(ALL_SYMBOLS_SNAPSHOT_FILE, &textStat);
+}
+
+/**
+ * Maps a symbols snapshot, pointing the time period cache and symbol arrays into it.
+ * Unless text is NULL, only accepts a snapshot made from a symbols file with exactly its
+ * modification time and size. Returns 1 on success, 0 otherwise.
+ */
+int mapSymbolsSnapshot(const char *filename, const struct stat *text) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(struct SymbolsSnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // mapping stays valid after close
+    if (mapping == MAP_FAILED) return 0;
+
+    const struct SymbolsSnapshotHeader *header = mapping;
+    if (memcmp(header->magic, SYMBOLS_SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+        header->count <= 0 || header->count > INT_MAX ||
+        (size_t)st.st_size != sizeof(*header) + header->count * (2 * sizeof(struct SymbolPeriod) + sizeof(union Symbol))) {
+        db_printf("Malformed or outdated symbols snapshot %s, falling back to text data", filename);
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+    if (text &&
+        (header->textSeconds != text->st_mtim.tv_sec || header->textNanoseconds != text->st_mtim.tv_nsec ||
+         header->textSize != text->st_size)) {
+        db_printf("Symbols snapshot %s is stale, falling back to text data", filename);
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+
+    // Never written through, and never unmapped
+    TPC_MAX_USED      = (int)header->count;
+    TIME_PERIOD_CACHE = (struct SymbolPeriod *)(header + 1);
+    SYMBOLS_BY_START  = TIME_PERIOD_CACHE + TPC_MAX_USED;
+    ALL_SYMBOLS       = (union Symbol *)(SYMBOLS_BY_START + TPC_MAX_USED);
+    return 1;
+}
+
+/**
+ * Writes the time period cache and symbol arrays out as a snapshot,
+ * recording the modification time and size of the symbols file they came from.
+ * Returns 1 on success, 0 (leaving no partial file behind) otherwise.
+ */
+int writeSymbolsSnapshot(const char *filename, const struct stat *text) {
+    char tempName[512];
+    inProgressName(tempName, sizeof(tempName), filename);
+
+    FILE *fp = fopen(tempName, "wb");
+    if (!fp) {
+        db_printf("Cannot write symbols snapshot %s", tempName);
+        return 0;
+    }
+
+    struct SymbolsSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SYMBOLS_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.count           = TPC_MAX_USED;
+    header.textSeconds     = text->st_mtim.tv_sec;
+    header.textNanoseconds = text->st_mtim.tv_nsec;
+    header.textSize        = text->st_size;
+    const size_t n = TPC_MAX_USED;
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(TIME_PERIOD_CACHE, sizeof(*TIME_PERIOD_CACHE), n, fp) == n &&
+             fwrite(SYMBOLS_BY_START, sizeof(*SYMBOLS_BY_START), n, fp) == n &&
+             fwrite(ALL_SYMBOLS, sizeof(*ALL_SYMBOLS), n, fp) == n;
+    ok = !fclose(fp) && ok;
+
+    // Rename is atomic, so concurrent runs never see a partial snapshot
+    if (!ok || rename(tempName, filename)) {
+        db_printf("Cannot write symbols snapshot %s", filename);
+        remove(tempName);
+        return 0;
+    }
+    return 1;
 }
 
 /**
@@ -148,41 +416,80 @@ void initializeTimePeriodCache(void) {
  */
 
 long getHistoricalPrice(const union Symbol *symbol, const time_t time) {
-    pthread_t tid = pthread_self();
-    int i;
-    for (i = 0; i < MAX_PC_THREADS && PRICE_CACHES[i]; ++i) {
-        if (pthread_equal(PRICE_CACHES[i]->thread_id, tid)) {
-            return getPriceFromCache(symbol, time, PRICE_CACHES[i]);
-        }
+    long row;
+    const struct Prices *p = findHistoricalRow(symbol, time, &row);
+    return historicalBarValue(p, BarOpen, row);
+}
+
+long getHistoricalBarField(const union Symbol *symbol, const time_t time, enum BarField field) {
+    long row;
+    const struct Prices *p = findHistoricalRow(symbol, time, &row);
+    return historicalBarValue(p, field, row);
+}
+
+time_t getNextHistoricalBarTime(const union Symbol *symbol, const time_t time) {
+    long row;
+    const struct Prices *p = findHistoricalRow(symbol, time, &row);
+    // Times before the first bar are clamped to it
+    if (historicalTime(p, row) > time) return historicalTime(p, row);
+    const long lastRow = (p->validRows > 1 ? p->validRows - 2 : 0);
+    return (row < lastRow ? historicalTime(p, row + 1) : 0);
+}
+
+void getHistoricalBar(const union Symbol *symbol, const time_t time, long bar[NUM_BAR_FIELDS]) {
+    long row;
+    const struct Prices *p = findHistoricalRow(symbol, time, &row);
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+        bar[f] = historicalBarValue(p, f, row);
     }
-    fprintf(stderr, "No price cache initialized for thread %lu\n", tid);
-    exit(1);
 }
 
-long getHistoricalPriceTimePeriod(const union Symbol *symbol, time_t *start, time_t *end) {
-    if (!TPC_MAX_USED) {
-        fprintf(stderr, "Time Period Cache not initialized. Call initializeTimePeriodCache() first\n");
-        exit(1);
+void getHistoricalPriceMoments(const union Symbol *symbol, time_t start, time_t end, double *mean, double *variance) {
+    const struct PriceAggregates *a = findAggregates(symbol);
+    if (end <= start) {
+        *mean     = (double)getHistoricalPrice(symbol, start);
+        *variance = 0.0;
+        return;
     }
+    double span = (double)(end - start);
+    *mean = (weightedIntegral(symbol, a->weightedSums, end, 0) -
+             weightedIntegral(symbol, a->weightedSums, start, 0)) / span;
+    double meanSquare = (weightedIntegral(symbol, a->weightedSquareSums, end, 1) -
+                         weightedIntegral(symbol, a->weightedSquareSums, start, 1)) / span;
+    *variance = meanSquare - (*mean) * (*mean);
+    // Rounding can leave a tiny negative for a flat window
+    if (*variance < 0.0) *variance = 0.0;
+}
 
-    // Binary search for symbol id
-    int mn, mx, split;
-    mn = 0;
-    mx = TPC_MAX_USED - 1;
-    while (mn < mx) {
-        split = (mx + mn) / 2;
-        if (TIME_PERIOD_CACHE[split].symbol.id < symbol->id) {
-            mn = split + 1;
-        } else {
-            mx = split;
+void getHistoricalPriceRange(const union Symbol *symbol, time_t start, time_t end, long *min, long *max) {
+    const struct PriceAggregates *a = findAggregates(symbol);
+    long first, last;
+    findHistoricalRow(symbol, start, &first);
+    findHistoricalRow(symbol, (end > start ? end - 1 : start), &last);
+
+    // Walk up the trees from both ends of the leaf range
+    *min = a->minTree[a->rows + first];
+    *max = a->maxTree[a->rows + first];
+    for (long lo = a->rows + first, hi = a->rows + last + 1; lo < hi; lo /= 2, hi /= 2) {
+        if (lo & 1) {
+            if (a->minTree[lo] < *min) *min = a->minTree[lo];
+            if (a->maxTree[lo] > *max) *max = a->maxTree[lo];
+            ++lo;
+        }
+        if (hi & 1) {
+            --hi;
+            if (a->minTree[hi] < *min) *min = a->minTree[hi];
+            if (a->maxTree[hi] > *max) *max = a->maxTree[hi];
         }
     }
+}
 
-    // Check if symbol was found
-    if (TIME_PERIOD_CACHE[mx].symbol.id != symbol->id) return 0;
+long getHistoricalPriceTimePeriod(const union Symbol *symbol, time_t *start, time_t *end) {
+    struct PriceArenaSlot *slot = findArenaSlot(symbol);
+    if (!slot) return 0;
 
-    *start = TIME_PERIOD_CACHE[mx].start;
-    *end   = TIME_PERIOD_CACHE[mx].end;
+    *start = slot->start;
+    *end   = slot->end;
     return 1;
 }
 
@@ -198,45 +505,200 @@ const union Symbol *getAllSymbols(int *n) {
 
 
 
+const struct SymbolPeriod *getSymbolsByStart(time_t requiredDataStart, int *n) {
+    if (!TPC_MAX_USED) {
+        fprintf(stderr, "Time Period Cache not initialized. Call initializeTimePeriodCache() first\n");
+        exit(1);
+    }
+
+    int low = 0, high = TPC_MAX_USED, mid;
+    if (requiredDataStart) {
+        while (low < high) {
+            mid = (low + high) / 2;
+            if (SYMBOLS_BY_START[mid].start <= requiredDataStart) low = mid + 1;
+            else high = mid;
+        }
+    }
+    *n = high;
+    return SYMBOLS_BY_START;
+}
+
+int openHistoricalPriceStore(const union Symbol *symbol, long *rows, long *stride) {
+    char symbolName[SYMBOL_LENGTH + 1];
+    strncpy(symbolName, symbol->name, SYMBOL_LENGTH);
+    symbolName[SYMBOL_LENGTH] = 0;
+
+    char textName[256], storeName[256];
+    struct stat textStat, storeStat;
+    int haveText  = findPriceFile(PRICE_FILENAME_FORMATS, NUM_PRICE_FILENAME_FORMATS, symbolName, textName, sizeof(textName), &textStat);
+    int haveStore = findPriceFile(PRICE_STORE_FILENAME_FORMATS, NUM_PRICE_STORE_FILENAME_FORMATS, symbolName, storeName, sizeof(storeName), &storeStat);
+    int rebuild   = !haveStore;
+    // A missing store is rebuilt before opening it, an unusable one
+    // (truncated, from another version, or from another version of the text file) after trying to
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (rebuild) {
+            // Without a text file there's nothing to rebuild from, so leave the failure to the caller
+            if (!haveText) return -1;
+            // Loading writes the store as a side effect, as it can't map an unusable one
+            struct Prices p;
+            p.symbol.id = symbol->id;
+            loadHistoricalPrice(&p);
+            if (p.mapping) {
+                munmap(p.mapping, p.mappingLength);
+            } else {
+                free(p.times);
+            }
+            snprintf(storeName, sizeof(storeName), PRICE_STORE_FILENAME_FORMATS[0], symbolName);
+        }
+
+        int fd = open(storeName, O_RDONLY);
+        if (fd < 0) return -1;
+        struct PriceStoreHeader header;
+        if (!fstat(fd, &storeStat) &&
+            pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            checkPriceStoreHeader(&header, storeStat.st_size, storeName) &&
+            priceStoreMatchesText(&header, haveText ? &textStat : NULL, storeName)) {
+            *rows   = header.rows;
+            *stride = columnStride(header.rows);
+            return fd;
+        }
+        close(fd);
+        if (rebuild) break;
+        rebuild = 1;
+    }
+    return -1;
+}
+
+void getHistoricalPriceStats(unsigned long totals[NUM_PRICE_STATS]) {
+    pthread_mutex_lock(&PRICE_STATS_LOCK);
+    for (int s = 0; s < NUM_PRICE_STATS; ++s) {
+        totals[s] = RETIRED_PRICE_STATS[s];
+    }
+    for (struct PriceStatsContext *c = PRICE_STATS_THREADS; c; c = c->next) {
+        for (int s = 0; s < NUM_PRICE_STATS; ++s) {
+            totals[s] += atomic_load_explicit(c->counts + s, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&PRICE_STATS_LOCK);
+}
+
+void printHistoricalPriceStats(void) {
+    unsigned long totals[NUM_PRICE_STATS];
+    getHistoricalPriceStats(totals);
+
+    printf("Price cache statistics:\n");
+    for (int s = 0; s < NUM_PRICE_STATS; ++s) {
+        printf("  %-24s %lu\n", PRICE_STAT_NAMES[s], totals[s]);
+    }
+    if (totals[StatLookups]) {
+        printf("  %-24s %.4f%%\n", "Hit rate", 100.0 * totals[StatHits] / totals[StatLookups]);
+    }
+    if (!PRICE_ARENA) return;
+
+    // Rank loaded symbols by misses
+    long arenaSize = 1L << PRICE_ARENA_BITS;
+    struct PriceArenaSlot **slots = malloc(sizeof(*slots) * arenaSize);
+    int numSlots = 0;
+    for (long i = 0; i < arenaSize; ++i) {
+        if (PRICE_ARENA[i].id && atomic_load_explicit(&PRICE_ARENA[i].misses, memory_order_relaxed)) {
+            slots[numSlots++] = PRICE_ARENA + i;
+        }
+    }
+    qsort(slots, numSlots, sizeof(*slots), compareSlotMisses);
+    if (numSlots) {
+        printf("  Most missed symbols:\n    %-*s %10s %12s\n", SYMBOL_LENGTH, "Symbol", "Misses", "Load (ms)");
+    }
+    union Symbol symbol;
+    for (int i = 0; i < numSlots && i < PRICE_STATS_TOP_SYMBOLS; ++i) {
+        symbol.id = slots[i]->id;
+        printf("    %-*.*s %10ld %12.3f\n", SYMBOL_LENGTH, SYMBOL_LENGTH, symbol.name,
+            atomic_load_explicit(&slots[i]->misses, memory_order_relaxed),
+            atomic_load_explicit(&slots[i]->loadNanoseconds, memory_order_relaxed) / 1e6);
+    }
+    free(slots);
+    fflush(stdout);
+}
+
 /**
  * Helpers
  */
 
-long getPriceFromCache(const union Symbol *symbol, const time_t time, struct PriceCache *priceCache) {
-    struct Prices *p;
-    struct Prices *pEnd = priceCache->entries + PRICE_CACHE_ENTRIES;
-    struct Prices *lruEntry = priceCache->entries;
-    long lrUsage = lruEntry->lastUsage;
-
-    // Find correct entry, if possible
-    for (p = priceCache->entries; p < pEnd && p->symbol.id; ++p) {
-        if (p->symbol.id == symbol->id &&
-            p->times[0] <= time &&
-            p->times[p->validRows - 1] >= time) {
-            // Found the entry we want to read.
-            break;
-        }
-        if (p->lastUsage < lrUsage) {
-            lruEntry = p;
-            lrUsage  = p->lastUsage;
-        }
+/**
+ * Adds amount to one of the calling thread's counters,
+ * registering them for getHistoricalPriceStats on first use.
+ */
+void countPriceStat(enum PriceStat stat, unsigned long amount) {
+    if (!PRICE_STATS.registered) {
+        pthread_once(&PRICE_STATS_KEY_ONCE, createPriceStatsKey);
+        pthread_mutex_lock(&PRICE_STATS_LOCK);
+        PRICE_STATS.prev = NULL;
+        PRICE_STATS.next = PRICE_STATS_THREADS;
+        if (PRICE_STATS_THREADS) PRICE_STATS_THREADS->prev = &PRICE_STATS;
+        PRICE_STATS_THREADS = &PRICE_STATS;
+        pthread_mutex_unlock(&PRICE_STATS_LOCK);
+        // Retire these counters when the thread exits, before its storage goes away
+        pthread_setspecific(PRICE_STATS_KEY, &PRICE_STATS);
+        PRICE_STATS.registered = 1;
+    }
+    atomic_store_explicit(PRICE_STATS.counts + stat,
+        atomic_load_explicit(PRICE_STATS.counts + stat, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void createPriceStatsKey(void) {
+    pthread_key_create(&PRICE_STATS_KEY, retirePriceStats);
+}
+
+void retirePriceStats(void *context) {
+    struct PriceStatsContext *c = context;
+    pthread_mutex_lock(&PRICE_STATS_LOCK);
+    for (int s = 0; s < NUM_PRICE_STATS; ++s) {
+        RETIRED_PRICE_STATS[s] += atomic_load_explicit(c->counts + s, memory_order_relaxed);
     }
+    if (c->prev) c->prev->next = c->next;
+    else PRICE_STATS_THREADS = c->next;
+    if (c->next) c->next->prev = c->prev;
+    pthread_mutex_unlock(&PRICE_STATS_LOCK);
+}
 
-    if (p >= pEnd) {
-        // No match found, no empty entry available.
-        // Replace the LRU entry with needed chunk
-        p = lruEntry;
-        lruEntry->symbol.id = symbol->id;
-        loadHistoricalPrice(lruEntry, time);
-    } else if (!p->symbol.id) {
-        // No match found, empty entry available.
-        // Load that entry with needed chunk
-        p->symbol.id = symbol->id;
-        loadHistoricalPrice(p, time);
-    } // else, match found, don't do anything
+int compareSlotMisses(const void *a, const void *b) {
+    long x = atomic_load_explicit(&(*(struct PriceArenaSlot * const *)a)->misses, memory_order_relaxed);
+    long y = atomic_load_explicit(&(*(struct PriceArenaSlot * const *)b)->misses, memory_order_relaxed);
+    return (x < y) - (x > y);
+}
 
-    // At this point, no matter which path was taken,
-    // p points to a cache entry with the correct data
+/**
+ * Finds the last row at or before time in symbol's history, loading it if needed.
+ * Returns the history, and stores the row index in *row.
+ */
+const struct Prices *findHistoricalRow(const union Symbol *symbol, const time_t time, long *row) {
+    struct PriceArenaSlot *slot = findArenaSlot(symbol);
+    if (!slot) {
+        fprintf(stderr, "No data for symbol %.*s\n", SYMBOL_LENGTH, symbol->name);
+        exit(1);
+    }
+
+    countPriceStat(StatLookups, 1);
+    struct Prices *p = atomic_load_explicit(&slot->prices, memory_order_acquire);
+    if (p) {
+        countPriceStat(StatHits, 1);
+    } else {
+        countPriceStat(StatMisses, 1);
+        atomic_fetch_add_explicit(&slot->misses, 1, memory_order_relaxed);
+        p = loadArenaSlot(slot);
+    }
+    // The searches below never choose the last row, so neither do these
+    if (time <= slot->firstTime) {
+        *row = 0;
+        return p;
+    }
+    if (time >= slot->lastTime) {
+        *row = slot->lastRow;
+        return p;
+    }
+    if (p->packed) {
+        *row = findPackedRow(p, time);
+        return p;
+    }
 
     time_t *mn, *mx, *split;
     mn = p->times;
@@ -252,100 +714,442 @@ long getPriceFromCache(const union Symbol *symbol, const time_t time, struct Pri
         }
     }
 
-    p->lastUsage = ++(priceCache->usageCounter);
-    return p->prices[mn - p->times];
+    *row = mn - p->times;
+    return p;
 }
 
-void loadHistoricalPrice(struct Prices *p, const time_t time) {
+/**
+ * As the search in findHistoricalRow, for a packed history.
+ * Matches it exactly, including never choosing the last row.
+ */
+long findPackedRow(const struct Prices *p, const time_t time) {
+    const struct PackedColumn *times = p->packed->columns;
+    const long lastRow = (p->validRows > 1 ? p->validRows - 2 : 0);
+
+    // Find the last block starting at or before time, then the last row within it
+    const long block = lastAtOrBefore(times->firsts, packedColumnBlocks(times), time);
+    const long *blockTimes = decodedColumn(p, block, 0);
+    long row = block * PRICE_PACK_BLOCK_ROWS + lastAtOrBefore(blockTimes, packedBlockRows(times, block), time);
+    return (row < lastRow ? row : lastRow);
+}
+
+/**
+ * Interpolation search for the last of n ascending values that's at most target,
+ * or the first value if they're all greater.
+ */
+long lastAtOrBefore(const long *values, long n, long target) {
+    long mn = 0, mx = n - 1, split;
+    if (values[mx] <= target) return mx;
+    while (mx - mn > 1) {
+        split = mn + ( ((mx - mn) * (target - values[mn])) / (values[mx] - values[mn]) );
+        split = (mx > split ? (mn < split ? split : mn + 1) : mx - 1);
+        if (values[split] <= target) {
+            mn = split;
+        } else {
+            mx = split;
+        }
+    }
+    return mn;
+}
+
+long historicalBarValue(const struct Prices *p, enum BarField field, long row) {
+    if (!p->packed) return p->bars[field][row];
+    return decodedColumn(p, row / PRICE_PACK_BLOCK_ROWS, field + 1)[row % PRICE_PACK_BLOCK_ROWS];
+}
+
+/**
+ * Returns the given column (0 for times, BarField + 1 for bars) of a block of packed history p,
+ * decoding it into this thread's block cache if it isn't there already.
+ */
+const long *decodedColumn(const struct Prices *p, long block, int column) {
+    struct DecodedBlock *d = DECODED_BLOCKS +
+        ((((uintptr_t)p ^ (uintptr_t)block) * PRICE_ARENA_HASH_MULTIPLIER) >> (64 - DECODED_BLOCK_CACHE_BITS));
+    if (d->prices != p || d->block != block) {
+        if (d->prices) countPriceStat(StatBlockEvictions, 1);
+        d->prices = p;
+        d->block  = block;
+        d->decodedColumns = 0;
+    }
+    if (!(d->decodedColumns & (1u << column))) {
+        countPriceStat(StatBlockMisses, 1);
+        unpackBlock(p->packed->columns + column, block, d->columns[column]);
+        d->decodedColumns |= 1u << column;
+    } else {
+        countPriceStat(StatBlockHits, 1);
+    }
+    return d->columns[column];
+}
+
+time_t historicalTime(const struct Prices *p, long row) {
+    if (!p->packed) return p->times[row];
+    return decodedColumn(p, row / PRICE_PACK_BLOCK_ROWS, 0)[row % PRICE_PACK_BLOCK_ROWS];
+}
+
+/**
+ * Returns symbol's window statistics, building them on first use.
+ */
+const struct PriceAggregates *findAggregates(const union Symbol *symbol) {
+    struct PriceArenaSlot *slot = findArenaSlot(symbol);
+    if (!slot) {
+        fprintf(stderr, "No data for symbol %.*s\n", SYMBOL_LENGTH, symbol->name);
+        exit(1);
+    }
+
+    struct PriceAggregates *a = atomic_load_explicit(&slot->aggregates, memory_order_acquire);
+    if (a) return a;
+
+    struct Prices *p = atomic_load_explicit(&slot->prices, memory_order_acquire);
+    if (!p) {
+        p = loadArenaSlot(slot);
+    }
+    pthread_mutex_t *lock = PRICE_ARENA_LOCKS + ((slot - PRICE_ARENA) % PRICE_ARENA_LOCK_STRIPES);
+    pthread_mutex_lock(lock);
+    a = atomic_load_explicit(&slot->aggregates, memory_order_relaxed);
+    if (!a) {
+        a = buildAggregates(p);
+        atomic_store_explicit(&slot->aggregates, a, memory_order_release);
+    }
+    pthread_mutex_unlock(lock);
+    return a;
+}
+
+struct PriceAggregates *buildAggregates(const struct Prices *p) {
+    struct PriceAggregates *a = malloc(sizeof(*a));
+    const long n = p->validRows;
+    a->rows               = n;
+    a->weightedSums       = malloc(sizeof(double) * n);
+    a->weightedSquareSums = malloc(sizeof(double) * n);
+    a->minTree            = malloc(sizeof(long) * 2 * n);
+    a->maxTree            = malloc(sizeof(long) * 2 * n);
+    if (!a->weightedSums || !a->weightedSquareSums || !a->minTree || !a->maxTree) {
+        fprintf(stderr, "Cannot allocate price aggregates for %.*s\n", SYMBOL_LENGTH, p->symbol.name);
+        exit(1);
+    }
+
+    long value;
+    double price, width;
+    a->weightedSums[0] = a->weightedSquareSums[0] = 0.0;
+    for (long r = 0; r < n; ++r) {
+        value = historicalBarValue(p, BarOpen, r);
+        price = (double)value;
+        if (r + 1 < n) {
+            width = (double)(historicalTime(p, r + 1) - historicalTime(p, r));
+            a->weightedSums[r + 1]       = a->weightedSums[r] + price * width;
+            a->weightedSquareSums[r + 1] = a->weightedSquareSums[r] + price * price * width;
+        }
+        a->minTree[n + r] = a->maxTree[n + r] = value;
+    }
+    for (long i = n - 1; i > 0; --i) {
+        a->minTree[i] = (a->minTree[2*i] < a->minTree[2*i + 1] ? a->minTree[2*i] : a->minTree[2*i + 1]);
+        a->maxTree[i] = (a->maxTree[2*i] > a->maxTree[2*i + 1] ? a->maxTree[2*i] : a->maxTree[2*i + 1]);
+    }
+    return a;
+}
+
+/**
+ * Integral of the price (or its square), from the first row's time up to time.
+ * Uses the same row for each time as getHistoricalPrice, so it's negative before the first row,
+ * and keeps accumulating the row it settles on past the end.
+ */
+double weightedIntegral(const union Symbol *symbol, const double *sums, time_t time, int squared) {
+    long row;
+    const struct Prices *p = findHistoricalRow(symbol, time, &row);
+    double price = (double)historicalBarValue(p, BarOpen, row);
+    return sums[row] + (squared ? price * price : price) * (double)(time - historicalTime(p, row));
+}
+
+struct PriceArenaSlot *findArenaSlot(const union Symbol *symbol) {
+    if (!PRICE_ARENA) {
+        fprintf(stderr, "Price arena not initialized. Call historicalPriceInit() first\n");
+        exit(1);
+    }
+
+    const long mask = (1L << PRICE_ARENA_BITS) - 1;
+    long i = (long)((symbol->id * PRICE_ARENA_HASH_MULTIPLIER) >> (64 - PRICE_ARENA_BITS));
+    while (PRICE_ARENA[i].id) {
+        if (PRICE_ARENA[i].id == symbol->id) return PRICE_ARENA + i;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+struct Prices *loadArenaSlot(struct PriceArenaSlot *slot) {
+    pthread_mutex_t *lock = PRICE_ARENA_LOCKS + ((slot - PRICE_ARENA) % PRICE_ARENA_LOCK_STRIPES);
+    pthread_mutex_lock(lock);
+    // Another thread may have finished loading while we waited for the lock
+    struct Prices *p = atomic_load_explicit(&slot->prices, memory_order_relaxed);
+    if (!p) {
+        struct timespec loadStart, loadEnd;
+        clock_gettime(CLOCK_MONOTONIC, &loadStart);
+        p = malloc(sizeof(*p));
+        p->symbol.id = slot->id;
+        loadHistoricalPrice(p);
+        slot->firstTime = p->times[0];
+        slot->lastTime  = p->times[p->validRows - 1];
+        slot->lastRow   = (p->validRows > 1 ? p->validRows - 2 : 0);
+        if (PACK_PRICES) {
+            packHistoricalPrice(p);
+        }
+        atomic_store_explicit(&slot->prices, p, memory_order_release);
+        clock_gettime(CLOCK_MONOTONIC, &loadEnd);
+        long nanoseconds = (loadEnd.tv_sec - loadStart.tv_sec) * 1000000000L + (loadEnd.tv_nsec - loadStart.tv_nsec);
+        atomic_store_explicit(&slot->loadNanoseconds, nanoseconds, memory_order_relaxed);
+        countPriceStat(StatLoads, 1);
+        countPriceStat(StatLoadNanoseconds, nanoseconds);
+    }
+    pthread_mutex_unlock(lock);
+    return p;
+}
+
+/**
+ * Adds a request for the loader threads.
+ * Returns 0 without queueing it if the queue is full.
+ */
+int queuePriceRequest(struct PriceArenaSlot *slot, time_t start, time_t end) {
+    int queued = 0;
+    pthread_mutex_lock(&PREFETCH_QUEUE.lock);
+    if (PREFETCH_QUEUE.size < PRICE_PREFETCH_QUEUE_LENGTH) {
+        PREFETCH_QUEUE.requests[PREFETCH_QUEUE.front].slot    = slot;
+        PREFETCH_QUEUE.requests[PREFETCH_QUEUE.front].start   = start;
+        PREFETCH_QUEUE.requests[PREFETCH_QUEUE.front].end     = end;
+        PREFETCH_QUEUE.front = (PREFETCH_QUEUE.front + 1) % PRICE_PREFETCH_QUEUE_LENGTH;
+        ++PREFETCH_QUEUE.size;
+        pthread_cond_signal(&PREFETCH_QUEUE.nonEmpty);
+        queued = 1;
+    }
+    pthread_mutex_unlock(&PREFETCH_QUEUE.lock);
+    return queued;
+}
+
+/**
+ * Background loader thread, one of PRICE_LOADER_THREADS.
+ * Loads requested slots, and faults in the requested window of mapped series,
+ * so that disk waits land here instead of in the workers.
+ */
+// Add GCC unused attribute to stop GCC complaining
+// if I don't use this variable in the body.
+void *runPriceLoader(__attribute__ ((unused)) void *dummy) {
+    struct PrefetchRequest request;
+    struct Prices *p;
+    volatile const char *page;
+    long fromRow, toRow;
+    while (1) {
+        pthread_mutex_lock(&PREFETCH_QUEUE.lock);
+        while (!PREFETCH_QUEUE.size) {
+            pthread_cond_wait(&PREFETCH_QUEUE.nonEmpty, &PREFETCH_QUEUE.lock);
+        }
+        request = PREFETCH_QUEUE.requests[PREFETCH_QUEUE.back];
+        PREFETCH_QUEUE.back = (PREFETCH_QUEUE.back + 1) % PRICE_PREFETCH_QUEUE_LENGTH;
+        --PREFETCH_QUEUE.size;
+        pthread_mutex_unlock(&PREFETCH_QUEUE.lock);
+
+        p = atomic_load_explicit(&request.slot->prices, memory_order_acquire);
+        if (!p) {
+            p = loadArenaSlot(request.slot);
+        }
+        if (!p->mapping) continue; // heap-backed series are already resident
+
+        // Cover the window now, so readers find it resident.
+        // The rest of the series was already advised in when it was mapped.
+        fromRow = lastAtOrBefore(p->times, p->validRows, request.start);
+        toRow   = lastAtOrBefore(p->times, p->validRows, request.end) + 1;
+        if (toRow > p->validRows) toRow = p->validRows;
+        if (fromRow >= toRow) continue;
+        // Touch one byte per page of each column, faulting it in for every thread
+        for (page = (const char *)(p->times + fromRow); page < (const char *)(p->times + toRow); page += PAGE_BYTES) {
+            (void)*page;
+        }
+        for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+            for (page = (const char *)(p->bars[f] + fromRow); page < (const char *)(p->bars[f] + toRow); page += PAGE_BYTES) {
+                (void)*page;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds the most preferred existing file among formats, for symbolName.
+ * Returns 1 and leaves its name in buf and its status in st, if one exists.
+ */
+int findPriceFile(const char **formats, int numFormats, const char *symbolName, char *buf, int bufSize, struct stat *st) {
+    for (int i = 0; i < numFormats; ++i) {
+        snprintf(buf, bufSize, formats[i], symbolName);
+        if (!stat(buf, st)) return 1;
+    }
+    return 0;
+}
+
+void loadHistoricalPrice(struct Prices *p) {
+    p->mapping = NULL;
+    p->packed  = NULL;
+
     const int bufSize = 256;
     char buf[bufSize];
     memset(buf, 0, bufSize);
-    long prevLineStart, thisLineStart;
-    prevLineStart = thisLineStart = 0;
+    char storeName[bufSize];
 
     // Make a null-terminated string:
     char symbolName[SYMBOL_LENGTH + 1];
     strncpy(symbolName, p->symbol.name, SYMBOL_LENGTH);
     symbolName[SYMBOL_LENGTH] = 0;
 
-    // Find a data file for this symbol
-    FILE *fp = NULL;
-    for (int i = 0; i < NUM_PRICE_FILENAME_FORMATS; ++i) {
-        snprintf(buf, bufSize, PRICE_FILENAME_FORMATS[i], symbolName);
-        if ((fp = fopen(buf, "r"))) {
-            // File successfully opened. Stop searching.
-            break;
-        }
-        // File wasn't successfully opened, move to next possible file.
+    // Find data files for this symbol
+    struct stat textStat, storeStat;
+    int haveText  = findPriceFile(PRICE_FILENAME_FORMATS, NUM_PRICE_FILENAME_FORMATS, symbolName, buf, bufSize, &textStat);
+    int haveStore = findPriceFile(PRICE_STORE_FILENAME_FORMATS, NUM_PRICE_STORE_FILENAME_FORMATS, symbolName, storeName, bufSize, &storeStat);
+
+    // A binary store holds the whole history, no parsing required.
+    // A store made from any other version of its text file is stale, and gets rebuilt below.
+    if (haveStore && mapHistoricalPrice(p, storeName, haveText ? &textStat : NULL)) {
+        countPriceStat(StatBytesMapped, p->mappingLength);
+        return;
     }
-    if (!fp) {
+
+    FILE *fp = NULL;
+    if (!haveText || !(fp = fopen(buf, "r"))) {
         fprintf(stderr, "No data file found for symbol %s\n", symbolName);
         exit(1);
     }
 
-    int timeCol, priceCol, col, maxCol;
-    timeCol = priceCol = -1;
+    long loadedRows = parseHistoricalPrice(p, fp);
+    fclose(fp);
+    countPriceStat(StatBytesParsed, textStat.st_size);
+    if (!loadedRows) {
+        fprintf(stderr, "No price data for symbol %s\n", symbolName);
+        exit(1);
+    }
+
+    // Leave a store behind, so later runs can map this symbol instead of parsing it
+    snprintf(storeName, bufSize, PRICE_STORE_FILENAME_FORMATS[0], symbolName);
+    writeHistoricalPriceStore(p, storeName, &textStat);
+}
+
+/**
+ * Name to write filename under until it's complete, unique to this thread,
+ * so concurrent writers of the same file never share one.
+ */
+void inProgressName(char *buf, int bufSize, const char *filename) {
+    snprintf(buf, bufSize, "%s.%d.%lx.in-progress", filename, (int)getpid(), (unsigned long)pthread_self());
+}
+
+/**
+ * Checks that header is from this version of the store format, and that size is exactly the
+ * size of a store with its number of rows. Reports filename if not, and returns 0.
+ */
+int checkPriceStoreHeader(const struct PriceStoreHeader *header, off_t size, const char *filename) {
+    if (!memcmp(header->magic, PRICE_STORE_MAGIC, sizeof(header->magic)) &&
+        header->rows > 0 &&
+        (size_t)size == sizeof(*header) + sizeof(long) * columnStride(header->rows) * (NUM_BAR_FIELDS + 1)) {
+        return 1;
+    }
+    // Only the last byte of the magic is the version
+    if (memcmp(header->magic, PRICE_STORE_MAGIC, sizeof(header->magic) - 1) ||
+        !memcmp(header->magic, PRICE_STORE_MAGIC, sizeof(header->magic))) {
+        fprintf(stderr, "Malformed price store %s, falling back to text data\n", filename);
+    } else {
+        db_printf("Outdated price store version %s, falling back to text data", filename);
+    }
+    return 0;
+}
+
+/**
+ * Checks that header was made from a text file with exactly text's modification time and size,
+ * or that text is NULL. Reports filename if not, and returns 0.
+ */
+// filename is only reported in debug builds
+int priceStoreMatchesText(const struct PriceStoreHeader *header, const struct stat *text, __attribute__ ((unused)) const char *filename) {
+    if (text &&
+        (header->textSeconds != text->st_mtim.tv_sec || header->textNanoseconds != text->st_mtim.tv_nsec ||
+         header->textSize != text->st_size)) {
+        db_printf("Price store %s is stale, falling back to text data", filename);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Number of longs each column of a history with the given rows occupies,
+ * once padded to keep the next column aligned.
+ */
+long columnStride(long rows) {
+    const long perLine = PRICE_COLUMN_ALIGNMENT / sizeof(long);
+    return (rows + perLine - 1) / perLine * perLine;
+}
+
+/**
+ * Points p's columns into a single new aligned heap block, with room for capacity rows.
+ */
+void allocatePriceColumns(struct Prices *p, long capacity) {
+    long stride = columnStride(capacity);
+    p->times = aligned_alloc(PRICE_COLUMN_ALIGNMENT, sizeof(long) * stride * (NUM_BAR_FIELDS + 1));
+    if (!p->times) {
+        fprintf(stderr, "Cannot allocate %ld rows of price data\n", capacity);
+        exit(1);
+    }
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+        p->bars[f] = p->times + stride * (f + 1);
+    }
+}
+
+long parseHistoricalPrice(struct Prices *p, FILE *fp) {
+    const int bufSize = 256;
+    char buf[bufSize];
+    memset(buf, 0, bufSize);
+
+    int timeCol, col, maxCol, lastCol;
+    int fieldCols[NUM_BAR_FIELDS];
+    timeCol = -1;
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) fieldCols[f] = -1;
 
     char *back, *front;
 
-    time_t *nextTime = p->times;
-    long *nextPrice = p->prices;
-    double tempPrice;
+    long capacity = PRICE_SERIES_LENGTH;
+    allocatePriceColumns(p, capacity);
+    double tempValue;
     long loadedRows = 0;
 
     time_t rowTime;
 
-    // Look for column header, and find timestamp & open columns
-    while ((timeCol < 0 || priceCol < 0) &&
+    // Look for column header, and find timestamp & bar columns
+    while ((timeCol < 0 || fieldCols[BarOpen] < 0) &&
            fgets(buf, bufSize, fp)) {
-        back = front = buf;
         col = 0;
-        while (*back) {
-            while (*front && *front != ',') ++front;
-            if (!strncmp(back, "Unix Timestamp", front - back)) {
+        lastCol = 0;
+        for (back = buf; !lastCol; back = front + 1) {
+            for (front = back; *front && *front != ',' && *front != '\n' && *front != '\r'; ++front) ;
+            lastCol = (*front != ',');
+            *front = 0;
+            if (!strcmp(back, "Unix Timestamp")) {
                 timeCol = col;
             }
-            if (!strncmp(back, "Open", front - back)) {
-                priceCol = col;
+            for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+                if (!strcmp(back, BAR_FIELD_NAMES[f])) {
+                    fieldCols[f] = col;
+                }
             }
-            back = ++front;
             ++col;
         }
-        prevLineStart = thisLineStart;
-        thisLineStart = ftell(fp);
     }
-    maxCol = (timeCol < priceCol ? priceCol : timeCol);
+    maxCol = timeCol;
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+        if (fieldCols[f] > maxCol) maxCol = fieldCols[f];
+    }
 
-    // Skim forward through the file,
-    // looking for the desired time
+    // Read in the whole history, growing the columns as needed
     while (fgets(buf, bufSize, fp)) {
-        back  = buf;
-        front = buf - 1;
-        col   = timeCol + 1;
-        while (*back && col) {
-            back = ++front;
-            while (*front && *front != ',') ++front;
-            --col;
-        }
-        if (!col) {
-            *front = 0;
-            sscanf(back, "%ld", &rowTime);
-            if (rowTime / 1000 >= time) {
-                // Found the first line that's at least the desired time
-                // Seek to the previous line (to catch a time prior to desired)
-                // Then move on to the reading phase.
-                fseek(fp, prevLineStart, SEEK_SET);
-                break;
+        if (loadedRows >= capacity) {
+            struct Prices old = *p;
+            capacity *= 2;
+            allocatePriceColumns(p, capacity);
+            memcpy(p->times, old.times, sizeof(*p->times) * loadedRows);
+            for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+                memcpy(p->bars[f], old.bars[f], sizeof(*p->bars[f]) * loadedRows);
             }
+            free(old.times);
         }
-        prevLineStart = thisLineStart;
-        thisLineStart = ftell(fp);
-    }
-
-    // Having adjusted the file pointer to the start
-    // of the desired data, read in as much as we can
-    while (loadedRows < PRICE_SERIES_LENGTH &&
-           fgets(buf, bufSize, fp)) {
+        // Columns missing from the file repeat the open, or are 0 for volume
+        p->bars[BarVolume][loadedRows] = 0;
         back = front = buf;
         col = 0;
         while (col <= maxCol && *front) {
@@ -353,20 +1157,136 @@ void loadHistoricalPrice(struct Prices *p, const time_t time) {
             *front = 0;
             if (col == timeCol) {
                 sscanf(back, "%ld", &rowTime);
-                *nextTime++ = rowTime / 1000;
-            } else if (col == priceCol) {
-                // read price as fractional dollars, store as integer cents
-                sscanf(back, "%lf", &tempPrice);
-                *(nextPrice++) = (long)round(tempPrice * DOLLAR);
-            } // else, not a column we care about, keep going
+                p->times[loadedRows] = rowTime / 1000;
+            } else {
+                for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+                    if (col == fieldCols[f]) {
+                        // read prices as fractional dollars, store as integer DOLLAR units
+                        sscanf(back, "%lf", &tempValue);
+                        p->bars[f][loadedRows] = (long)round(f == BarVolume ? tempValue : tempValue * DOLLAR);
+                    }
+                } // else, not a column we care about, keep going
+            }
             back = ++front;
             ++col;
         }
+        for (int f = BarHigh; f <= BarClose; ++f) {
+            if (fieldCols[f] < 0) p->bars[f][loadedRows] = p->bars[BarOpen][loadedRows];
+        }
         ++loadedRows;
     }
 
-    fclose(fp);
+
     p->validRows = loadedRows;
+    return loadedRows;
+}
+
+int writeHistoricalPriceStore(const struct Prices *p, const char *filename, const struct stat *text) {
+    char tempName[512];
+    inProgressName(tempName, sizeof(tempName), filename);
+
+    FILE *fp = fopen(tempName, "wb");
+    if (!fp) {
+        db_printf("Cannot write price store %s", tempName);
+        return 0;
+    }
+
+    struct PriceStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PRICE_STORE_MAGIC, sizeof(header.magic));
+    header.rows            = p->validRows;
+    header.textSeconds     = text->st_mtim.tv_sec;
+    header.textNanoseconds = text->st_mtim.tv_nsec;
+    header.textSize        = text->st_size;
+    const long padding[PRICE_COLUMN_ALIGNMENT / sizeof(long)] = {0};
+    const size_t padRows = columnStride(p->validRows) - p->validRows;
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(p->times, sizeof(*p->times), p->validRows, fp) == (size_t)p->validRows &&
+             fwrite(padding, sizeof(long), padRows, fp) == padRows;
+    for (int f = 0; f < NUM_BAR_FIELDS && ok; ++f) {
+        ok = fwrite(p->bars[f], sizeof(*p->bars[f]), p->validRows, fp) == (size_t)p->validRows &&
+             fwrite(padding, sizeof(long), padRows, fp) == padRows;
+    }
+    ok = !fclose(fp) && ok;
+
+    // Rename is atomic, so concurrent runs never see a partial store
+    if (!ok || rename(tempName, filename)) {
+        db_printf("Cannot write price store %s", filename);
+        remove(tempName);
+        return 0;
+    }
+    return 1;
+}
+
+void packHistoricalPrice(struct Prices *p) {
+    struct PackedPrices *packed = malloc(sizeof(*packed));
+    packColumn(packed->columns, p->times, p->validRows);
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+        packColumn(packed->columns + f + 1, p->bars[f], p->validRows);
+    }
+
+#ifdef DEBUG
+    size_t packedBytes = 0;
+    for (int c = 0; c <= NUM_BAR_FIELDS; ++c) {
+        packedBytes += packedColumnBytes(packed->columns + c);
+    }
+    db_printf("Packed %.*s from %ld to %zu bytes", SYMBOL_LENGTH, p->symbol.name,
+        (long)(sizeof(long) * p->validRows * (NUM_BAR_FIELDS + 1)), packedBytes);
+#endif
+
+    if (p->mapping) {
+        munmap(p->mapping, p->mappingLength);
+    } else {
+        free(p->times);
+    }
+    p->mapping = NULL;
+    p->times   = NULL;
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+        p->bars[f] = NULL;
+    }
+    p->packed = packed;
+}
+
+int mapHistoricalPrice(struct Prices *p, const char *filename, const struct stat *text) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(struct PriceStoreHeader)) {
+        close(fd);
+        return 0;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // mapping stays valid after close
+    if (mapping == MAP_FAILED) return 0;
+
+    const struct PriceStoreHeader *header = mapping;
+    if (!checkPriceStoreHeader(header, st.st_size, filename) ||
+        !priceStoreMatchesText(header, text, filename)) {
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+
+    // Series are small, so ask for all of it to be read in now, in the background,
+    // rather than tracking which parts each reader is about to need.
+    // Scenarios start at random times, so readers are spread over the whole series at once.
+    madvise(mapping, st.st_size, MADV_WILLNEED);
+
+    long stride = columnStride(header->rows);
+    p->mapping       = mapping;
+    p->mappingLength = st.st_size;
+    p->validRows     = header->rows;
+    p->times         = (time_t *)(header + 1);
+    for (int f = 0; f < NUM_BAR_FIELDS; ++f) {
+        p->bars[f] = p->times + stride * (f + 1);
+    }
+    return 1;
+}
+
+int compareSymbolPeriods(const void *a, const void *b) {
+    const struct SymbolPeriod *x = a, *y = b;
+    if (x->start != y->start) return (x->start < y->start ? -1 : 1);
+    return (x->symbol.id < y->symbol.id ? -1 : x->symbol.id > y->symbol.id);
 }
 
 // Hoare partition quicksort, as described at https://en.wikipedia.org/wiki/Quicksort#Hoare_partition_scheme
@@ -376,7 +1296,7 @@ void quicksortTPC(int start, int end) {
     SYMBOL_ID_TYPE pivot = TIME_PERIOD_CACHE[(start + end) / 2].symbol.id;
     int low = start;
     int high = end;
-    struct TimePeriod temp;
+    struct SymbolPeriod temp;
     while (low < high) {
         while (TIME_PERIOD_CACHE[low].symbol.id < pivot) ++low;
         while (TIME_PERIOD_CACHE[high].symbol.id > pivot) --high;
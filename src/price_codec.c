@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "price_codec.h"
+
+/**
+ * Forward Declarations
+ */
+
+uint64_t zigzagDifference(long from, long to);
+
+/**
+ * Initializers & Modifiers
+ */
+
+void packColumn(struct PackedColumn *column, const long *values, long rows) {
+    long numBlocks = (rows + PRICE_PACK_BLOCK_ROWS - 1) / PRICE_PACK_BLOCK_ROWS;
+    column->rows    = rows;
+    column->firsts  = malloc(sizeof(long) * numBlocks);
+    column->offsets = malloc(sizeof(long) * numBlocks);
+    column->widths  = malloc(sizeof(unsigned char) * numBlocks);
+    if (!column->firsts || !column->offsets || !column->widths) {
+        fprintf(stderr, "Cannot allocate packed column of %ld rows\n", rows);
+        exit(1);
+    }
+
+    // Pick each block's width, and lay the blocks out back to back
+    long totalWords = 0;
+    long start, end, i;
+    uint64_t widest;
+    int width;
+    for (long b = 0; b < numBlocks; ++b) {
+        start = b * PRICE_PACK_BLOCK_ROWS;
+        end   = (start + PRICE_PACK_BLOCK_ROWS < rows ? start + PRICE_PACK_BLOCK_ROWS : rows);
+        widest = 0;
+        for (i = start + 1; i < end; ++i) {
+            widest |= zigzagDifference(values[i - 1], values[i]);
+        }
+        for (width = 0; width < 64 && (widest >> width); ++width) ;
+        column->firsts[b]  = values[start];
+        column->widths[b]  = (unsigned char)width;
+        column->offsets[b] = totalWords;
+        totalWords += ((end - start - 1) * width + 63) / 64;
+    }
+
+    // One extra word lets the decoder always read a word past the last one it needs
+    column->words = calloc(totalWords + 1, sizeof(uint64_t));
+    if (!column->words) {
+        fprintf(stderr, "Cannot allocate packed column of %ld rows\n", rows);
+        exit(1);
+    }
+    uint64_t *words, z;
+    long bit;
+    int shift;
+    for (long b = 0; b < numBlocks; ++b) {
+        start = b * PRICE_PACK_BLOCK_ROWS;
+        end   = (start + PRICE_PACK_BLOCK_ROWS < rows ? start + PRICE_PACK_BLOCK_ROWS : rows);
+        width = column->widths[b];
+        words = column->words + column->offsets[b];
+        for (i = start + 1; i < end; ++i) {
+            z     = zigzagDifference(values[i - 1], values[i]);
+            bit   = (i - start - 1) * width;
+            shift = bit & 63;
+            words[bit >> 6] |= z << shift;
+            if (shift + width > 64) {
+                words[(bit >> 6) + 1] |= z >> (64 - shift);
+            }
+        }
+    }
+}
+
+void freePackedColumn(struct PackedColumn *column) {
+    free(column->firsts);
+    free(column->offsets);
+    free(column->widths);
+    free(column->words);
+}
+
+/**
+ * Public Accessors
+ */
+
+long packedColumnBlocks(const struct PackedColumn *column) {
+    return (column->rows + PRICE_PACK_BLOCK_ROWS - 1) / PRICE_PACK_BLOCK_ROWS;
+}
+
+long packedBlockRows(const struct PackedColumn *column, long block) {
+    long remaining = column->rows - block * PRICE_PACK_BLOCK_ROWS;
+    return (remaining < PRICE_PACK_BLOCK_ROWS ? remaining : PRICE_PACK_BLOCK_ROWS);
+}
+
+void unpackBlock(const struct PackedColumn *column, long block, long *values) {
+    const uint64_t *words = column->words + column->offsets[block];
+    const int width = column->widths[block];
+    const uint64_t mask = (width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1);
+    const long n = packedBlockRows(column, block);
+    uint64_t differences[PRICE_PACK_BLOCK_ROWS];
+
+    // Extract every difference without branching on word boundaries.
+    // The high word is shifted in two steps, so a shift of 0 clears it instead of being undefined.
+    uint64_t bit;
+    int shift;
+    for (long i = 1; i < n; ++i) {
+        bit   = (uint64_t)(i - 1) * width;
+        shift = bit & 63;
+        differences[i] = ((words[bit >> 6] >> shift) | (words[(bit >> 6) + 1] << 1 << (63 - shift))) & mask;
+    }
+
+    // Undo the zigzag, and accumulate. Unsigned, so extreme differences wrap back exactly.
+    uint64_t value = (uint64_t)column->firsts[block];
+    values[0] = (long)value;
+    for (long i = 1; i < n; ++i) {
+        value += (differences[i] >> 1) ^ -(differences[i] & 1);
+        values[i] = (long)value;
+    }
+}
+
+size_t packedColumnBytes(const struct PackedColumn *column) {
+    long numBlocks = packedColumnBlocks(column);
+    long lastBlock = numBlocks - 1;
+    long totalWords = column->offsets[lastBlock] +
+        ((packedBlockRows(column, lastBlock) - 1) * column->widths[lastBlock] + 63) / 64 + 1;
+    return numBlocks * (2 * sizeof(long) + sizeof(unsigned char)) + totalWords * sizeof(uint64_t);
+}
+
+/**
+ * Helpers
+ */
+
+/**
+ * Maps the signed difference to - from onto an unsigned value,
+ * with small differences of either sign getting small codes.
+ */
+uint64_t zigzagDifference(long from, long to) {
+    uint64_t d = (uint64_t)to - (uint64_t)from;
+    return (d << 1) ^ -(d >> 63);
+}
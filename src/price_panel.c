@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "load_prices.h"
+
+#include "price_panel.h"
+
+#define PRICE_PANEL_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+
+static const struct PricePanel *ACTIVE_PRICE_PANEL = NULL;
+
+/**
+ * Forward Declarations
+ */
+
+long columnTableStart(const struct PricePanel *panel, const union Symbol *symbol);
+
+/**
+ * Initializers & Modifiers
+ */
+
+struct PricePanel *buildPricePanel(const union Symbol *symbols, int numSymbols, time_t start, time_t end, time_t stepSize) {
+    if (stepSize <= 0 || end < start || numSymbols <= 0) {
+        fprintf(stderr, "Invalid price panel: %d symbols, times %ld to %ld, step %ld\n", numSymbols, start, end, stepSize);
+        exit(1);
+    }
+
+    struct PricePanel *panel = malloc(sizeof(*panel));
+    const long perLine = PRICE_PANEL_ALIGNMENT / sizeof(long);
+    panel->numSymbols = numSymbols;
+    panel->stepSize   = stepSize;
+    panel->start      = start - (start % stepSize);
+    panel->numSteps   = (end - panel->start) / stepSize + 1;
+    panel->rowStride  = (numSymbols + perLine - 1) / perLine * perLine;
+    panel->prices     = aligned_alloc(PRICE_PANEL_ALIGNMENT, sizeof(long) * panel->rowStride * panel->numSteps);
+    panel->symbols    = malloc(sizeof(union Symbol) * numSymbols);
+    if (!panel->prices || !panel->symbols) {
+        fprintf(stderr, "Cannot allocate price panel of %d symbols x %ld steps\n", numSymbols, panel->numSteps);
+        exit(1);
+    }
+
+    // Size the column table to at least twice the number of symbols
+    for (panel->columnBits = 1; (1L << panel->columnBits) < 2L * numSymbols; ++panel->columnBits) ;
+    long tableSize = 1L << panel->columnBits;
+    long mask = tableSize - 1;
+    long j;
+    panel->columnTable = malloc(sizeof(int) * tableSize);
+    for (j = 0; j < tableSize; ++j) {
+        panel->columnTable[j] = -1;
+    }
+    for (int col = 0; col < numSymbols; ++col) {
+        panel->symbols[col].id = symbols[col].id;
+        j = columnTableStart(panel, symbols + col);
+        while (panel->columnTable[j] >= 0) {
+            if (panel->symbols[panel->columnTable[j]].id == symbols[col].id) {
+                fprintf(stderr, "Duplicate symbol %.*s in price panel\n", SYMBOL_LENGTH, symbols[col].name);
+                exit(1);
+            }
+            j = (j + 1) & mask;
+        }
+        panel->columnTable[j] = col;
+    }
+
+    // Fill one symbol at a time, so each history is walked forward once
+    time_t t;
+    long step;
+    for (int col = 0; col < numSymbols; ++col) {
+        for (step = 0, t = panel->start; step < panel->numSteps; ++step, t += stepSize) {
+            panel->prices[step * panel->rowStride + col] = getHistoricalPrice(symbols + col, t);
+        }
+    }
+    // Zero the padding, so whole-row reads see defined values
+    for (step = 0; step < panel->numSteps; ++step) {
+        for (long col = numSymbols; col < panel->rowStride; ++col) {
+            panel->prices[step * panel->rowStride + col] = 0;
+        }
+    }
+
+    return panel;
+}
+
+void freePricePanel(struct PricePanel *panel) {
+    if (ACTIVE_PRICE_PANEL == panel) {
+        ACTIVE_PRICE_PANEL = NULL;
+    }
+    free(panel->prices);
+    free(panel->symbols);
+    free(panel->columnTable);
+    free(panel);
+}
+
+void usePricePanel(const struct PricePanel *panel) {
+    ACTIVE_PRICE_PANEL = panel;
+}
+
+/**
+ * Public Accessors
+ */
+
+const long *pricePanelRow(const struct PricePanel *panel, const time_t time) {
+    time_t offset = time - panel->start;
+    if (offset < 0 || offset % panel->stepSize) return NULL;
+    long step = offset / panel->stepSize;
+    if (step >= panel->numSteps) return NULL;
+    return panel->prices + step * panel->rowStride;
+}
+
+int pricePanelColumn(const struct PricePanel *panel, const union Symbol *symbol) {
+    const long mask = (1L << panel->columnBits) - 1;
+    long i = columnTableStart(panel, symbol);
+    while (panel->columnTable[i] >= 0) {
+        if (panel->symbols[panel->columnTable[i]].id == symbol->id) return panel->columnTable[i];
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+long getPanelPrice(const union Symbol *symbol, const time_t time) {
+    const struct PricePanel *panel = ACTIVE_PRICE_PANEL;
+    if (panel) {
+        const long *row = pricePanelRow(panel, time);
+        int col;
+        if (row && (col = pricePanelColumn(panel, symbol)) >= 0) {
+            return row[col];
+        }
+    }
+    return getHistoricalPrice(symbol, time);
+}
+
+double pricePanelBytes(int numSymbols, time_t start, time_t end, time_t stepSize) {
+    if (stepSize <= 0 || end < start || numSymbols <= 0) return 0;
+    const long perLine = PRICE_PANEL_ALIGNMENT / sizeof(long);
+    const long numSteps = (end - (start - (start % stepSize))) / stepSize + 1;
+    const long rowStride = (numSymbols + perLine - 1) / perLine * perLine;
+    return (double)sizeof(long) * rowStride * numSteps;
+}
+
+/**
+ * Helpers
+ */
+
+long columnTableStart(const struct PricePanel *panel, const union Symbol *symbol) {
+    return (long)((symbol->id * PRICE_PANEL_HASH_MULTIPLIER) >> (64 - panel->columnBits));
+}
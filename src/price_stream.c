@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "load_prices.h"
+
+#include "price_stream.h"
+
+#define PRICE_STREAM_TABLE_SIZE (1 << PRICE_STREAM_TABLE_BITS)
+#define PRICE_STREAM_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+
+// This thread's streams, by symbol, open-addressed
+static _Thread_local struct PriceStream *STREAMS[PRICE_STREAM_TABLE_SIZE];
+static _Thread_local int NUM_STREAMS = 0;
+static pthread_key_t STREAMS_KEY;
+static pthread_once_t STREAMS_KEY_ONCE = PTHREAD_ONCE_INIT;
+
+/**
+ * Forward Declarations
+ */
+
+struct PriceStream *findStream(const union Symbol *symbol);
+void createStreamsKey(void);
+void closeStreamsOnExit(void *dummy);
+void seekPriceStream(struct PriceStream *s, time_t time);
+void startChunkRead(struct PriceStream *s, struct PriceChunk *c, long firstRow);
+void finishChunkRead(struct PriceStream *s, struct PriceChunk *c);
+long readStoreTime(const struct PriceStream *s, long row);
+
+/**
+ * Public Accessors
+ */
+
+long getStreamedPrice(const union Symbol *symbol, const time_t time) {
+    return priceStreamPrice(findStream(symbol), time);
+}
+
+long priceStreamPrice(struct PriceStream *s, const time_t time) {
+    struct PriceChunk *c = s->chunks + s->current;
+    if (c->pending) finishChunkRead(s, c);
+    const long end = c->firstRow + c->rows;
+
+    if (!c->rows || (time < c->times[0] && c->firstRow)) {
+        // Before this chunk, so we've jumped back, probably to start another scenario
+        seekPriceStream(s, time);
+    } else if (time > c->times[c->rows - 1] && end < s->rows) {
+        // Past this chunk, and the next one should already be read in
+        struct PriceChunk *next = s->chunks + !s->current;
+        if (next->pending) finishChunkRead(s, next);
+        if (next->firstRow != end) {
+            seekPriceStream(s, time);
+        } else if (time < next->times[0]) {
+            s->cursor = c->rows - 1;
+        } else if (end + next->rows >= s->rows || time <= next->times[next->rows - 1]) {
+            s->current = !s->current;
+            s->cursor  = 0;
+            // Refill the chunk we're done with, while the next one is used
+            if (end + next->rows < s->rows) startChunkRead(s, c, end + next->rows);
+        } else {
+            seekPriceStream(s, time);
+        }
+    }
+    c = s->chunks + s->current;
+    if (time < c->times[0]) return c->prices[0];
+
+    // Usually a step or two past the last lookup
+    long r = s->cursor;
+    if (c->times[r] > time) {
+        long low = 0, high = r, mid;
+        while (low < high) {
+            mid = (low + high + 1) / 2;
+            if (c->times[mid] <= time) low = mid;
+            else high = mid - 1;
+        }
+        r = low;
+    } else {
+        while (r + 1 < c->rows && c->times[r + 1] <= time) ++r;
+    }
+    s->cursor = r;
+    return c->prices[r];
+}
+
+/**
+ * Public Modifiers
+ */
+
+void openPriceStream(struct PriceStream *s, const union Symbol *symbol) {
+    s->symbol.id = symbol->id;
+    s->fd = openHistoricalPriceStore(symbol, &s->rows, &s->stride);
+    if (s->fd < 0) {
+        fprintf(stderr, "No price data for symbol %.*s\n", SYMBOL_LENGTH, symbol->name);
+        exit(1);
+    }
+    if (s->rows > 1) --s->rows;
+    for (int i = 0; i < 2; ++i) {
+        s->chunks[i].firstRow = -1;
+        s->chunks[i].rows     = 0;
+        s->chunks[i].pending  = 0;
+    }
+    s->current = 0;
+    s->cursor  = 0;
+}
+
+void closePriceStream(struct PriceStream *s) {
+    for (int i = 0; i < 2; ++i) {
+        if (s->chunks[i].pending) finishChunkRead(s, s->chunks + i);
+    }
+    close(s->fd);
+}
+
+void closeStreamedPrices(void) {
+    for (int i = 0; i < PRICE_STREAM_TABLE_SIZE; ++i) {
+        if (STREAMS[i]) {
+            closePriceStream(STREAMS[i]);
+            free(STREAMS[i]);
+            STREAMS[i] = NULL;
+        }
+    }
+    NUM_STREAMS = 0;
+}
+
+/**
+ * Helpers
+ */
+
+struct PriceStream *findStream(const union Symbol *symbol) {
+    const long mask = PRICE_STREAM_TABLE_SIZE - 1;
+    long i = (long)((symbol->id * PRICE_STREAM_HASH_MULTIPLIER) >> (64 - PRICE_STREAM_TABLE_BITS));
+    while (STREAMS[i]) {
+        if (STREAMS[i]->symbol.id == symbol->id) return STREAMS[i];
+        i = (i + 1) & mask;
+    }
+
+    // Keep the table at most half full, so probes stay short.
+    // Once it fills, this thread has moved on through several scenarios' symbols,
+    // so start over rather than track which streams are still in use.
+    if (2 * (NUM_STREAMS + 1) > PRICE_STREAM_TABLE_SIZE) {
+        db_msg("Price stream table full, closing this thread's streams");
+        closeStreamedPrices();
+        i = (long)((symbol->id * PRICE_STREAM_HASH_MULTIPLIER) >> (64 - PRICE_STREAM_TABLE_BITS));
+    }
+    if (!NUM_STREAMS) {
+        pthread_once(&STREAMS_KEY_ONCE, createStreamsKey);
+        // Any non-NULL value, so the destructor runs
+        pthread_setspecific(STREAMS_KEY, STREAMS);
+    }
+    STREAMS[i] = malloc(sizeof(struct PriceStream));
+    openPriceStream(STREAMS[i], symbol);
+    ++NUM_STREAMS;
+    return STREAMS[i];
+}
+
+void createStreamsKey(void) {
+    pthread_key_create(&STREAMS_KEY, closeStreamsOnExit);
+}
+
+// Add GCC unused attribute to stop GCC complaining
+// if I don't use this variable in the body.
+void closeStreamsOnExit(__attribute__ ((unused)) void *dummy) {
+    closeStreamedPrices();
+}
+
+/**
+ * Reads the chunk holding the last row at or before time into the current chunk,
+ * and starts reading the chunk after it into the other.
+ */
+void seekPriceStream(struct PriceStream *s, time_t time) {
+    // Binary search the store's times column directly, so nothing is held but the chunks
+    long low = 0, high = s->rows - 1, mid;
+    while (low < high) {
+        mid = (low + high + 1) / 2;
+        if (readStoreTime(s, mid) <= time) low = mid;
+        else high = mid - 1;
+    }
+    const long firstRow = low - low % PRICE_STREAM_CHUNK_ROWS;
+
+    struct PriceChunk *c = s->chunks + s->current;
+    struct PriceChunk *next = s->chunks + !s->current;
+    if (next->pending) finishChunkRead(s, next);
+    if (next->firstRow == firstRow) {
+        // Already read in by the last seek or move
+        s->current = !s->current;
+        struct PriceChunk *swap = c;
+        c = next;
+        next = swap;
+    } else {
+        if (c->pending) finishChunkRead(s, c);
+        startChunkRead(s, c, firstRow);
+        finishChunkRead(s, c);
+    }
+    s->cursor = low - firstRow;
+    if (firstRow + c->rows < s->rows && next->firstRow != firstRow + c->rows) {
+        if (next->pending) finishChunkRead(s, next);
+        startChunkRead(s, next, firstRow + c->rows);
+    }
+}
+
+void startChunkRead(struct PriceStream *s, struct PriceChunk *c, long firstRow) {
+    c->firstRow = firstRow;
+    c->rows     = (s->rows - firstRow < PRICE_STREAM_CHUNK_ROWS ? s->rows - firstRow : PRICE_STREAM_CHUNK_ROWS);
+    void *buffers[2] = {c->times, c->prices};
+    const long columns[2] = {0, 1 + BarOpen};
+    for (int i = 0; i < 2; ++i) {
+        memset(c->reads + i, 0, sizeof(struct aiocb));
+        c->reads[i].aio_fildes = s->fd;
+        c->reads[i].aio_buf    = buffers[i];
+        c->reads[i].aio_nbytes = sizeof(long) * c->rows;
+        c->reads[i].aio_offset = sizeof(struct PriceStoreHeader) + sizeof(long) * (s->stride * columns[i] + firstRow);
+        if (aio_read(c->reads + i)) {
+            fprintf(stderr, "Error reading prices for symbol %.*s: %s\n", SYMBOL_LENGTH, s->symbol.name, strerror(errno));
+            exit(1);
+        }
+    }
+    c->pending = 1;
+}
+
+void finishChunkRead(struct PriceStream *s, struct PriceChunk *c) {
+    const struct aiocb *reads[2] = {c->reads, c->reads + 1};
+    for (int i = 0; i < 2; ++i) {
+        while (aio_error(reads[i]) == EINPROGRESS) {
+            aio_suspend(reads + i, 1, NULL);
+        }
+        if (aio_return(c->reads + i) != (ssize_t)(sizeof(long) * c->rows)) {
+            fprintf(stderr, "Error reading prices for symbol %.*s\n", SYMBOL_LENGTH, s->symbol.name);
+            exit(1);
+        }
+    }
+    c->pending = 0;
+}
+
+long readStoreTime(const struct PriceStream *s, long row) {
+    long time;
+    if (pread(s->fd, &time, sizeof(time), sizeof(struct PriceStoreHeader) + sizeof(long) * row) != sizeof(time)) {
+        fprintf(stderr, "Error reading prices for symbol %.*s\n", SYMBOL_LENGTH, s->symbol.name);
+        exit(1);
+    }
+    return time;
+}
@@ -4,43 +4,67 @@
 #include "types.h"
 #include "rng.h"
 
-#define MAX_RNG_THREADS 16
+// Arbitrary odd constant, so lazily-seeded threads don't replay the master's sequence
+#define RNG_SPAWN_SEED_MIX 2654435761u
 
-static pthread_t RNG_THREAD_IDS[MAX_RNG_THREADS];
-static unsigned int RNG_SEEDS[MAX_RNG_THREADS];
-static int RNG_IN_USE = 0;
+struct RngContext {
+    unsigned int seed;
+    int bound;
+};
+
+static unsigned int RNG_SPAWN_SEED = 0;
+static pthread_mutex_t RNG_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local struct RngContext RNG_CONTEXT;
+
+void bindRngContext(void);
 
 void tsRandInit(unsigned int seed) {
-    pthread_t tid = pthread_self();
-    RNG_THREAD_IDS[0] = tid;
-    RNG_SEEDS[0] = seed;
-    RNG_IN_USE = 1;
+    RNG_CONTEXT.seed  = seed;
+    RNG_CONTEXT.bound = 1;
+    pthread_mutex_lock(&RNG_LOCK);
+    RNG_SPAWN_SEED = seed * RNG_SPAWN_SEED_MIX;
+    pthread_mutex_unlock(&RNG_LOCK);
 }
 
-void tsRandAddThread(pthread_t tid) {
-    if (RNG_IN_USE >= MAX_RNG_THREADS) {
-        fprintf(stderr, "Max number of random number generators exceeded\n");
-        exit(1);
-    }
+unsigned int tsRandThreadSeed(void) {
+    // Child seeds are drawn from the calling thread's generator,
+    // so a given initial seed always produces the same thread seeds.
+    return (unsigned int)tsRand();
+}
 
-    RNG_THREAD_IDS[RNG_IN_USE] = tid;
-    pthread_t selfID = pthread_self();
-    for (int i = 0; i < RNG_IN_USE; ++i) {
-        if (pthread_equal(RNG_THREAD_IDS[i], selfID)) {
-            RNG_SEEDS[RNG_IN_USE] = rand_r(RNG_SEEDS + i);
-        }
-    }
-    ++RNG_IN_USE;
+void tsRandBindThread(unsigned int seed) {
+    RNG_CONTEXT.seed  = seed;
+    RNG_CONTEXT.bound = 1;
 }
 
 int tsRand() {
-    pthread_t tid = pthread_self();
-    for (int i = 0; i < RNG_IN_USE; ++i) {
-        if (pthread_equal(RNG_THREAD_IDS[i], tid)) {
-            int output = rand_r(RNG_SEEDS + i);
-            return output;
-        }
+    if (!RNG_CONTEXT.bound) bindRngContext();
+    return rand_r(&RNG_CONTEXT.seed);
+}
+
+void tsRandSample(int n, int count, int *chosen) {
+    char *taken = calloc(count, sizeof(char));
+    int i = 0, t;
+    for (int j = count - n; j < count; ++j) {
+        t = (int)(( (long)tsRand() * (j + 1) ) / ((long)RAND_MAX + 1));
+        // j itself can't have been drawn yet, since earlier draws were all below it
+        if (taken[t]) t = j;
+        taken[t] = 1;
+        chosen[i++] = t;
     }
-    fprintf(stderr, "No random number generator initialized for thread %lu\n", tid);
-    exit(1);
+    free(taken);
+}
+
+/**
+ * Runs on the first call to tsRand by a thread that was never given a seed.
+ * Derives a fresh one, which depends on the order threads first draw in,
+ * so warns that the run may not be reproducible.
+ */
+void bindRngContext(void) {
+    fprintf(stderr, "Warning: thread drew a random number without being seeded by tsRandBindThread. Results may not be reproducible.\n");
+    pthread_mutex_lock(&RNG_LOCK);
+    RNG_CONTEXT.seed = (unsigned int)rand_r(&RNG_SPAWN_SEED);
+    pthread_mutex_unlock(&RNG_LOCK);
+    RNG_CONTEXT.bound = 1;
 }
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "load_prices.h"
+#include "rng.h"
+
+#include "screening.h"
+
+#define SCREENING_BUCKET_BITS 8
+#define SCREENING_BUCKETS (1 << SCREENING_BUCKET_BITS)
+#define SCREENING_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+// Days kept per bucket once built, beyond those in use. Each holds a value for every symbol.
+#define SCREENING_DAYS_PER_BUCKET 4
+
+// Chained hash table of ScreeningDays, each chain guarded by its bucket's lock.
+// A day is built outside the lock, so only threads wanting that same day wait for it,
+// on their bucket's condition variable.
+struct ScreeningBucket {
+    pthread_mutex_t lock;
+    pthread_cond_t built;
+    struct ScreeningDay *days;
+    int numDays;
+};
+static struct ScreeningBucket SCREENING_DAYS[SCREENING_BUCKETS];
+static pthread_once_t SCREENING_ONCE = PTHREAD_ONCE_INIT;
+// Ticks once per lookup, to find each bucket's least recently used day
+static atomic_ulong SCREENING_CLOCK;
+
+/**
+ * Forward Declarations
+ */
+
+void initScreening(void);
+long screeningBucket(enum ScreenStatistic statistic, time_t history, time_t day);
+struct ScreeningDay *findScreeningDay(struct ScreeningBucket *b, enum ScreenStatistic statistic, time_t history, time_t day);
+void evictScreeningDays(struct ScreeningBucket *b);
+void freeScreeningDay(struct ScreeningDay *d);
+void buildScreeningDay(struct ScreeningDay *d);
+int compareScreenedSymbols(const void *a, const void *b);
+int firstScreenedAtLeast(const struct ScreeningDay *d, double value);
+int firstScreenedAbove(const struct ScreeningDay *d, double value);
+
+/**
+ * Public Accessors
+ */
+
+const struct ScreeningDay *getScreeningDay(enum ScreenStatistic statistic, time_t history, time_t time) {
+    pthread_once(&SCREENING_ONCE, initScreening);
+    const time_t day = time - (time % DAY);
+    struct ScreeningBucket *b = SCREENING_DAYS + screeningBucket(statistic, history, day);
+
+    pthread_mutex_lock(&b->lock);
+    struct ScreeningDay *d = findScreeningDay(b, statistic, history, day);
+    if (d) {
+        ++d->users;
+        // Another thread may be building this day, so wait for it rather than building it again
+        while (!d->built) pthread_cond_wait(&b->built, &b->lock);
+        pthread_mutex_unlock(&b->lock);
+        return d;
+    }
+    d = malloc(sizeof(*d));
+    d->statistic = statistic;
+    d->history   = history;
+    d->day       = day;
+    d->n         = 0;
+    d->symbols   = NULL;
+    d->users     = 1;
+    d->built     = 0;
+    d->lastUsed  = atomic_fetch_add_explicit(&SCREENING_CLOCK, 1, memory_order_relaxed);
+    d->next      = b->days;
+    b->days      = d;
+    ++b->numDays;
+    evictScreeningDays(b);
+    pthread_mutex_unlock(&b->lock);
+
+    buildScreeningDay(d);
+
+    pthread_mutex_lock(&b->lock);
+    d->built = 1;
+    pthread_cond_broadcast(&b->built);
+    pthread_mutex_unlock(&b->lock);
+    return d;
+}
+
+union Symbol *screenSymbols(enum ScreenStatistic statistic, time_t history, time_t time, double target, double epsilon, int n) {
+    const struct ScreeningDay *d = getScreeningDay(statistic, history, time);
+    if (d->n < n) {
+        fprintf(stderr, "Cannot choose %d symbols from %d symbols with data for the %ld seconds before time %ld\n", n, d->n, history, time);
+        exit(1);
+    }
+
+    union Symbol *chosenSymbols = malloc(sizeof(union Symbol) * n);
+    const double margin = fabs(epsilon * target);
+    int first = firstScreenedAtLeast(d, target - margin);
+    int count = firstScreenedAbove(d, target + margin) - first;
+
+    if (count < n) {
+        // Not enough matches, so take the n closest to target
+        db_printf("Only %d symbols within %.0lf%% of %lf, widening", count, epsilon * 100, target);
+        int low  = firstScreenedAtLeast(d, target);
+        int high = low;
+        while (high - low < n) {
+            if (high >= d->n || (low > 0 && target - d->symbols[low - 1].value <= d->symbols[high].value - target)) {
+                --low;
+            } else {
+                ++high;
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            chosenSymbols[i].id = d->symbols[low + i].symbol.id;
+        }
+        releaseScreeningDay(d);
+        return chosenSymbols;
+    }
+
+    int *chosen = malloc(sizeof(int) * n);
+    tsRandSample(n, count, chosen);
+    for (int i = 0; i < n; ++i) {
+        chosenSymbols[i].id = d->symbols[first + chosen[i]].symbol.id;
+    }
+    free(chosen);
+    releaseScreeningDay(d);
+    return chosenSymbols;
+}
+
+/**
+ * Public Modifiers
+ */
+
+void releaseScreeningDay(const struct ScreeningDay *day) {
+    struct ScreeningBucket *b = SCREENING_DAYS + screeningBucket(day->statistic, day->history, day->day);
+    struct ScreeningDay *d = (struct ScreeningDay *)day;
+    pthread_mutex_lock(&b->lock);
+    --d->users;
+    evictScreeningDays(b);
+    pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * Helpers
+ */
+
+void initScreening(void) {
+    for (int i = 0; i < SCREENING_BUCKETS; ++i) {
+        pthread_mutex_init(&SCREENING_DAYS[i].lock, NULL);
+        pthread_cond_init(&SCREENING_DAYS[i].built, NULL);
+        SCREENING_DAYS[i].days    = NULL;
+        SCREENING_DAYS[i].numDays = 0;
+    }
+    atomic_init(&SCREENING_CLOCK, 0);
+}
+
+long screeningBucket(enum ScreenStatistic statistic, time_t history, time_t day) {
+    uint64_t key = ((uint64_t)(day / DAY) << 32) ^ ((uint64_t)history << 2) ^ (uint64_t)statistic;
+    return (long)((key * SCREENING_HASH_MULTIPLIER) >> (64 - SCREENING_BUCKET_BITS));
+}
+
+/**
+ * Finds the day in b's chain, marking it as just used. Caller must hold b's lock.
+ */
+struct ScreeningDay *findScreeningDay(struct ScreeningBucket *b, enum ScreenStatistic statistic, time_t history, time_t day) {
+    struct ScreeningDay *d = b->days;
+    while (d && (d->statistic != statistic || d->history != history || d->day != day)) {
+        d = d->next;
+    }
+    if (d) d->lastUsed = atomic_fetch_add_explicit(&SCREENING_CLOCK, 1, memory_order_relaxed);
+    return d;
+}
+
+/**
+ * Frees b's least recently used days until it holds at most SCREENING_DAYS_PER_BUCKET,
+ * skipping any still in use, which are freed once released instead. Caller must hold b's lock.
+ */
+void evictScreeningDays(struct ScreeningBucket *b) {
+    while (b->numDays > SCREENING_DAYS_PER_BUCKET) {
+        struct ScreeningDay **oldest = NULL;
+        for (struct ScreeningDay **d = &b->days; *d; d = &(*d)->next) {
+            if (!(*d)->users && (!oldest || (*d)->lastUsed < (*oldest)->lastUsed)) oldest = d;
+        }
+        if (!oldest) return;
+        struct ScreeningDay *evicted = *oldest;
+        *oldest = evicted->next;
+        --b->numDays;
+        freeScreeningDay(evicted);
+    }
+}
+
+void freeScreeningDay(struct ScreeningDay *d) {
+    free(d->symbols);
+    free(d);
+}
+
+/**
+ * Fills in d's symbols and their values, for its statistic, history and day.
+ */
+void buildScreeningDay(struct ScreeningDay *d) {
+    const enum ScreenStatistic statistic = d->statistic;
+    const time_t history = d->history, day = d->day;
+    int numCandidates;
+    const struct SymbolPeriod *candidates = getSymbolsByStart(day - history, &numCandidates);
+
+    d->symbols = malloc(sizeof(struct ScreenedSymbol) * (numCandidates ? numCandidates : 1));
+
+    // Load every candidate concurrently, rather than one at a time as we measure them
+    union Symbol *preload = malloc(sizeof(union Symbol) * (numCandidates ? numCandidates : 1));
+    int numPreload = 0;
+    for (int i = 0; i < numCandidates; ++i) {
+        if (candidates[i].end >= day) preload[numPreload++].id = candidates[i].symbol.id;
+    }
+    preloadHistoricalPrices(preload, numPreload, day - history, day);
+    free(preload);
+
+    double mean, variance, value;
+    for (int i = 0; i < numCandidates; ++i) {
+        if (candidates[i].end < day) continue;
+        getHistoricalPriceMoments(&candidates[i].symbol, day - history, day, &mean, &variance);
+        value = (statistic == ScreenVolatility ? sqrt(variance) / mean : mean);
+        if (!isfinite(value)) continue;
+        d->symbols[d->n].value     = value;
+        d->symbols[d->n].symbol.id = candidates[i].symbol.id;
+        ++d->n;
+    }
+    qsort(d->symbols, d->n, sizeof(struct ScreenedSymbol), compareScreenedSymbols);
+}
+
+int compareScreenedSymbols(const void *a, const void *b) {
+    const struct ScreenedSymbol *x = a, *y = b;
+    if (x->value != y->value) return (x->value < y->value ? -1 : 1);
+    // Break ties by id, so the order doesn't depend on the symbols file
+    return (x->symbol.id < y->symbol.id ? -1 : x->symbol.id > y->symbol.id);
+}
+
+int firstScreenedAtLeast(const struct ScreeningDay *d, double value) {
+    int low = 0, high = d->n, mid;
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (d->symbols[mid].value < value) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+int firstScreenedAbove(const struct ScreeningDay *d, double value) {
+    int low = 0, high = d->n, mid;
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (d->symbols[mid].value <= value) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
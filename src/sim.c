@@ -11,15 +11,27 @@
 #include "rng.h"
 #include "execution.h"
 #include "load_prices.h"
+#include "price_panel.h"
+#include "price_stream.h"
 #include "strategies.h"
 #include "batch_execution.h"
 #include "strategy_testing.h"
+#include "strategy_sweep.h"
 #include "stats.h"
 #include "args_parser.h"
 
 static struct Options {
     int textDemo;  // 1 to run text-based demo of test strategy
     int graphDemo; // 1 to graph a demo of test strategy
+    int pricePanel; // 1 to resample all prices onto the step grid up front
+    int packPrices; // 1 to keep price histories compressed in memory
+    int cacheStats; // 1 to report price cache statistics on exit
+    int streamPrices; // 1 to replay prices from disk in chunks, rather than loading whole histories
+    int stepMinutes; // minutes each step advances
+    int barSteps;    // 1 to step from bar to bar, rather than stepMinutes at a time
+    int meanReversionGrid; // 1 to grid-test meanReversion's buy and sell factors instead
+    int checkSweep;  // 1 to check the meanReversion sweep against scalar runs
+    int forkWarmUps; // 1 to run the meanReversion grid one scenario at a time, from shared warm-ups
     int numIters;  // number of random setups
     int numTests;  // number of random starts per setup
     int numBins;   // number of bins on histogram
@@ -37,6 +49,10 @@ static struct Options {
     int    param2MinInt;
     int    param2MaxInt;
     double epsilon;
+    double buyFactorMin;
+    double buyFactorMax;
+    double sellFactorMin;
+    double sellFactorMax;
     int divisions1;
     int divisions2;
 } OPTIONS;
@@ -45,9 +61,15 @@ const char param1Name[] = "Target Price";
 const char param2Name[] = "Portfolio Size";
 struct SimState BASE_STATE;
 struct RandomizedStartArgs rsArgs;
+const struct MeanReversionArgs *MR_VARIANTS; // the meanReversion grid's cells, for meanReversionVary
 
 void parseArgs(int argc, char *argv[]);
 struct SimState *stateInit(double p1, double p2);
+union Symbol longestHistorySymbol(void);
+union Symbol *symbolsTradedDuring(time_t start, time_t end, int *n);
+struct MeanReversionSweep *meanReversionSweepInit(void);
+struct SimState *meanReversionStateInit(const struct MeanReversionSweep *sweep);
+void meanReversionVary(struct SimState *state, int variant);
 
 int main(int argc, char *argv[]) {
     parseArgs(argc, argv);
@@ -55,6 +77,10 @@ int main(int argc, char *argv[]) {
     unsigned int seed = time(0);
     printf("Seed value: %d\n", seed);
     tsRandInit(seed);
+    historicalPricePacking(OPTIONS.packPrices);
+    if (OPTIONS.cacheStats) {
+        atexit(printHistoricalPriceStats);
+    }
     historicalPriceInit();
 
     rsArgs.baseScenario = &BASE_STATE;
@@ -62,15 +88,45 @@ int main(int argc, char *argv[]) {
     rsArgs.n            = OPTIONS.numTests;
     rsArgs.minStart     = OPTIONS.periodStart;
     rsArgs.maxStart     = OPTIONS.periodEnd;
+    rsArgs.startGranularity = 0;
 
     initSimState(&BASE_STATE, 0);
     BASE_STATE.priceFn = getHistoricalPrice;
     BASE_STATE.cash    = OPTIONS.startCash;
+    BASE_STATE.stepSize = OPTIONS.stepMinutes * MINUTE;
+    if (OPTIONS.barSteps) {
+        // The symbol with the longest history serves as the market calendar
+        BASE_STATE.stepSymbol = longestHistorySymbol();
+    }
+
+    if (OPTIONS.pricePanel) {
+        // Align every run to the step grid, so all its prices come from the panel.
+        // Only symbols with data during the runs get a column; any others fall back to the histories.
+        time_t stepSize = BASE_STATE.stepSize;
+        time_t panelEnd = OPTIONS.periodEnd + OPTIONS.testLength + 2*stepSize;
+        int numSymbols;
+        union Symbol *symbols = symbolsTradedDuring(OPTIONS.periodStart, panelEnd, &numSymbols);
+        double panelBytes = pricePanelBytes(numSymbols, OPTIONS.periodStart, panelEnd, stepSize);
+        if (panelBytes > PRICE_PANEL_MAX_BYTES) {
+            fprintf(stderr, "Price panel of %d symbols would take %.1lf GB, more than the %.1lf GB limit. "
+                "Use a longer step or a shorter period, or drop -P.\n",
+                numSymbols, panelBytes / (1L << 30), (double)PRICE_PANEL_MAX_BYTES / (1L << 30));
+            exit(1);
+        }
+        printf("Building price panel of %d symbols (%.1lf MB)...\n", numSymbols, panelBytes / (1L << 20));
+        usePricePanel(buildPricePanel(symbols, numSymbols, OPTIONS.periodStart, panelEnd, stepSize));
+        free(symbols);
+        BASE_STATE.priceFn      = getPanelPrice;
+        rsArgs.startGranularity = stepSize;
+    } else if (OPTIONS.streamPrices) {
+        BASE_STATE.priceFn = getStreamedPrice;
+    }
 
     // Create a time horizon
     union Symbol thSymbol;
     strncpy(thSymbol.name, "HRZN", SYMBOL_LENGTH);
-    struct TimeHorizonArgs *thArgsControl = (struct TimeHorizonArgs *)makeCustomOrder(&BASE_STATE, &thSymbol, 1, timeHorizon)->aux;
+    struct TimeHorizonArgs *thArgsControl = (struct TimeHorizonArgs *)orderAux(&BASE_STATE,
+        makeCustomOrder(&BASE_STATE, &thSymbol, 1, timeHorizon, sizeof(struct TimeHorizonArgs)));
     thArgsControl->offset = OPTIONS.testLength;
     thArgsControl->cutoff = 0;
 
@@ -85,8 +141,7 @@ int main(int argc, char *argv[]) {
                 (OPTIONS.param1Min + OPTIONS.param1Max) / 2,
                 (OPTIONS.param2Min + OPTIONS.param2Max) / 2
             );
-        state->time = OPTIONS.periodStart + (time_t)( tsRand() * (double)(OPTIONS.periodEnd - OPTIONS.periodStart) / RAND_MAX );
-        historicalPriceAddThread(pthread_self());
+        state->time = randomStartTime(&rsArgs);
         runScenarioDemo(state, 100);
         free(state);
         return 0;
@@ -97,11 +152,63 @@ int main(int argc, char *argv[]) {
         double p2 = (OPTIONS.param2Min + OPTIONS.param2Max) / 2;
         printf("  %s: %.2lf\n  %s: %.2lf\n", param1Name, p1, param2Name, p2);
         struct SimState *state = stateInit(p1, p2);
-        state->time = OPTIONS.periodStart + (time_t)( tsRand() * (double)(OPTIONS.periodEnd - OPTIONS.periodStart) / RAND_MAX );
-        historicalPriceAddThread(pthread_self());
+        state->time = randomStartTime(&rsArgs);
         graphScenario(state);
         free(state);
         return 0;
+    } else if (OPTIONS.checkSweep) {
+        // Run every variant of the meanReversion grid in lockstep and one at a time, and compare
+        printf("Checking sweep against scalar runs...\n");
+        struct MeanReversionSweep *sweep = meanReversionSweepInit();
+        long mismatches = checkMeanReversionSweep(sweep, &rsArgs);
+        printf("%ld of %d runs differ\n", mismatches, sweep->n * rsArgs.n);
+        // And forked from shared warm-ups against set up from the start
+        printf("Checking forked warm-ups against unforked runs...\n");
+        struct SimState *state = meanReversionStateInit(sweep);
+        rsArgs.baseScenario = state;
+        long forkMismatches = checkRandomizedStartForked(&rsArgs, sweep->args[0].initialSamples, sweep->n, meanReversionVary);
+        printf("%ld of %d runs differ\n", forkMismatches, sweep->n * rsArgs.n);
+        free(state);
+        freeMeanReversionSweep(sweep);
+        return (mismatches || forkMismatches ? 1 : 0);
+    } else if (OPTIONS.meanReversionGrid) {
+        // Execute the test, with every grid cell a variant of one sweep
+        printf("Executing test...\n");
+        struct MeanReversionSweep *sweep = meanReversionSweepInit();
+        double *results = malloc(sizeof(*results) * sweep->n);
+        if (OPTIONS.forkWarmUps) {
+            // One scenario per cell and start, each start's warm-up run once and forked into every cell
+            struct SimState *state = meanReversionStateInit(sweep);
+            rsArgs.baseScenario = state;
+            void **resultEnds;
+            void **cash = randomizedStartForked(&rsArgs, sweep->args[0].initialSamples, sweep->n, meanReversionVary, &resultEnds);
+            for (int k = 0; k < sweep->n; ++k) {
+                results[k] = oms.metric(cash[k], resultEnds[k]);
+                free(cash[k]);
+            }
+            free(cash);
+            free(resultEnds);
+            free(state);
+        } else {
+            long *cash = randomizedStartSweep(sweep, &rsArgs);
+            for (int k = 0; k < sweep->n; ++k) {
+                results[k] = oms.metric(cash + k * rsArgs.n, cash + (k + 1) * rsArgs.n);
+            }
+            free(cash);
+        }
+        displayGrid2(
+                results,
+                OPTIONS.buyFactorMin,
+                OPTIONS.buyFactorMax,
+                OPTIONS.sellFactorMin,
+                OPTIONS.sellFactorMax,
+                OPTIONS.divisions1,
+                OPTIONS.divisions2,
+                "Buy Factor",
+                "Sell Factor"
+            );
+        free(results);
+        freeMeanReversionSweep(sweep);
     } else {
         // Execute the test
         printf("Executing test...\n");
@@ -134,6 +241,15 @@ int main(int argc, char *argv[]) {
 void initOptions(void) {
     OPTIONS.textDemo         = 0;
     OPTIONS.graphDemo        = 0;
+    OPTIONS.pricePanel       = 0;
+    OPTIONS.packPrices       = 0;
+    OPTIONS.cacheStats       = 0;
+    OPTIONS.streamPrices     = 0;
+    OPTIONS.stepMinutes      = 12*60;
+    OPTIONS.barSteps         = 0;
+    OPTIONS.meanReversionGrid = 0;
+    OPTIONS.checkSweep       = 0;
+    OPTIONS.forkWarmUps      = 0;
     OPTIONS.numIters         = 100;
     OPTIONS.numTests         = 1000;
     OPTIONS.numBins          = 15;
@@ -149,6 +265,10 @@ void initOptions(void) {
     OPTIONS.param2MinInt     = 0;
     OPTIONS.param2MaxInt     = 0;
     OPTIONS.epsilon          = 0.1;
+    OPTIONS.buyFactorMin     = 0.90;
+    OPTIONS.buyFactorMax     = 0.99;
+    OPTIONS.sellFactorMin    = 1.01;
+    OPTIONS.sellFactorMax    = 1.10;
     OPTIONS.divisions1       = 5;
     OPTIONS.divisions2       = 5;
 
@@ -240,6 +360,97 @@ void initParser(void) {
     cla.type          = CLA_FLAG;
     cla.valuePtr.iptr = &OPTIONS.graphDemo;
     addArg(&cla);
+
+    cla.description   = "Resample all prices onto the step grid before running, trading memory for speed";
+    cla.parameter     = 0;
+    cla.shortName     = 'P';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.pricePanel;
+    addArg(&cla);
+
+    cla.description   = "Keep price histories compressed in memory, trading speed for memory";
+    cla.parameter     = 0;
+    cla.shortName     = 'z';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.packPrices;
+    addArg(&cla);
+
+    cla.description   = "Report price cache statistics on exit";
+    cla.parameter     = 0;
+    cla.shortName     = 'S';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.cacheStats;
+    addArg(&cla);
+
+    cla.description   = "Replay prices from disk in fixed-size chunks, for histories too long to hold in memory";
+    cla.parameter     = 0;
+    cla.shortName     = 'R';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.streamPrices;
+    addArg(&cla);
+
+    cla.description   = "Advance n minutes each step";
+    cla.parameter     = 'n';
+    cla.shortName     = 'm';
+    cla.type          = CLA_INT;
+    cla.valuePtr.iptr = &OPTIONS.stepMinutes;
+    addArg(&cla);
+
+    cla.description   = "Step from one daily bar to the next, skipping times with no new prices";
+    cla.parameter     = 0;
+    cla.shortName     = 'b';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.barSteps;
+    addArg(&cla);
+
+    cla.description   = "Grid-test meanReversion's buy factor vs. sell factor instead, running all cells in lockstep";
+    cla.parameter     = 0;
+    cla.shortName     = 'M';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.meanReversionGrid;
+    addArg(&cla);
+
+    cla.description   = "Set minimum meanReversion buy factor of x";
+    cla.parameter     = 'x';
+    cla.shortName     = 'i';
+    cla.type          = CLA_DOUBLE;
+    cla.valuePtr.dptr = &OPTIONS.buyFactorMin;
+    addArg(&cla);
+
+    cla.description   = "Set maximum meanReversion buy factor of x";
+    cla.parameter     = 'x';
+    cla.shortName     = 'j';
+    cla.type          = CLA_DOUBLE;
+    cla.valuePtr.dptr = &OPTIONS.buyFactorMax;
+    addArg(&cla);
+
+    cla.description   = "Set minimum meanReversion sell factor of x";
+    cla.parameter     = 'x';
+    cla.shortName     = 'k';
+    cla.type          = CLA_DOUBLE;
+    cla.valuePtr.dptr = &OPTIONS.sellFactorMin;
+    addArg(&cla);
+
+    cla.description   = "Set maximum meanReversion sell factor of x";
+    cla.parameter     = 'x';
+    cla.shortName     = 'l';
+    cla.type          = CLA_DOUBLE;
+    cla.valuePtr.dptr = &OPTIONS.sellFactorMax;
+    addArg(&cla);
+
+    cla.description   = "Check the meanReversion grid's lockstep runs against scalar runs of each cell, rather than doing a full test";
+    cla.parameter     = 0;
+    cla.shortName     = 'C';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.checkSweep;
+    addArg(&cla);
+
+    cla.description   = "Run the meanReversion grid one scenario per cell, forking each start's warm-up into every cell";
+    cla.parameter     = 0;
+    cla.shortName     = 'F';
+    cla.type          = CLA_FLAG;
+    cla.valuePtr.iptr = &OPTIONS.forkWarmUps;
+    addArg(&cla);
 }
 
 void parseArgs(int argc, char *argv[]) {
@@ -256,6 +467,16 @@ void parseArgs(int argc, char *argv[]) {
         printHelpMessage();
         exit(1);
     }
+    if (OPTIONS.stepMinutes <= 0) {
+        fprintf(stderr, "Step size must be a positive number of minutes.\n");
+        printHelpMessage();
+        exit(1);
+    }
+    if (OPTIONS.barSteps && OPTIONS.pricePanel) {
+        fprintf(stderr, "Cannot resample prices onto a step grid when stepping from bar to bar. Specify one or the other only.\n");
+        printHelpMessage();
+        exit(1);
+    }
 }
 
 struct SimState *stateInit(double p1, double p2) {
@@ -264,7 +485,8 @@ struct SimState *stateInit(double p1, double p2) {
 
     union Symbol prSymbol;
     strncpy(prSymbol.name, "MP-REBAL", SYMBOL_LENGTH);
-    struct MeanPricePortfolioRebalanceArgs *args = (struct MeanPricePortfolioRebalanceArgs *)makeCustomOrder(state, &prSymbol, 1, meanPricePortfolioRebalance)->aux;
+    struct MeanPricePortfolioRebalanceArgs *args = (struct MeanPricePortfolioRebalanceArgs *)orderAux(state,
+        makeCustomOrder(state, &prSymbol, 1, meanPricePortfolioRebalance, sizeof(struct MeanPricePortfolioRebalanceArgs)));
     args->targetPrice      = p1;
     args->epsilon          = OPTIONS.epsilon;
     args->history          = 1*MONTH;
@@ -274,3 +496,74 @@ struct SimState *stateInit(double p1, double p2) {
 
     return state;
 }
+
+union Symbol longestHistorySymbol(void) {
+    int numSymbols, longest = 0;
+    const struct SymbolPeriod *periods = getSymbolsByStart(0, &numSymbols);
+    for (int i = 1; i < numSymbols; ++i) {
+        if (periods[i].end - periods[i].start > periods[longest].end - periods[longest].start) longest = i;
+    }
+    return periods[longest].symbol;
+}
+
+/**
+ * Returns the symbols with price data at some time from start to end, writing their number to n.
+ * Caller must free the result.
+ */
+union Symbol *symbolsTradedDuring(time_t start, time_t end, int *n) {
+    int numSymbols;
+    const struct SymbolPeriod *periods = getSymbolsByStart(end, &numSymbols);
+    union Symbol *symbols = malloc(sizeof(union Symbol) * (numSymbols ? numSymbols : 1));
+    *n = 0;
+    for (int i = 0; i < numSymbols; ++i) {
+        if (periods[i].end >= start) symbols[(*n)++].id = periods[i].symbol.id;
+    }
+    return symbols;
+}
+
+struct MeanReversionSweep *meanReversionSweepInit(void) {
+    const int n = OPTIONS.divisions1 * OPTIONS.divisions2;
+    struct MeanReversionArgs *variants = malloc(sizeof(*variants) * n);
+    // Warm the average up over a month of steps, and weight it over about that long
+    const int samples = (int)(1*MONTH / BASE_STATE.stepSize);
+    for (int k1 = 0; k1 < OPTIONS.divisions1; ++k1) {
+        for (int k2 = 0; k2 < OPTIONS.divisions2; ++k2) {
+            struct MeanReversionArgs *args = variants + k2 + k1*OPTIONS.divisions2;
+            args->emaDiscount    = 1 - 1.0 / samples;
+            args->ema            = 0;
+            args->buyFactor      = (OPTIONS.divisions1 > 1 ? OPTIONS.buyFactorMin + (OPTIONS.buyFactorMax - OPTIONS.buyFactorMin) * k1 / (OPTIONS.divisions1 - 1) : OPTIONS.buyFactorMin);
+            args->sellFactor     = (OPTIONS.divisions2 > 1 ? OPTIONS.sellFactorMin + (OPTIONS.sellFactorMax - OPTIONS.sellFactorMin) * k2 / (OPTIONS.divisions2 - 1) : OPTIONS.sellFactorMin);
+            args->stopFactor     = 0.9;
+            args->initialSamples = samples;
+            args->boughtPrice    = 0;
+            args->boughtQuantity = 0;
+        }
+    }
+
+    const union Symbol symbol = longestHistorySymbol();
+    struct MeanReversionSweep *sweep = makeMeanReversionSweep(&symbol, variants, n, OPTIONS.testLength);
+    free(variants);
+    return sweep;
+}
+
+struct SimState *meanReversionStateInit(const struct MeanReversionSweep *sweep) {
+    struct SimState *state = malloc(sizeof(*state));
+    copySimState(state, &BASE_STATE);
+
+    // Every cell starts out as the first, until meanReversionVary makes it its own
+    union Symbol mrSymbol = sweep->symbol;
+    struct MeanReversionArgs *args = (struct MeanReversionArgs *)orderAux(state,
+        makeCustomOrder(state, &mrSymbol, 1, meanReversion, sizeof(struct MeanReversionArgs)));
+    *args = sweep->args[0];
+    MR_VARIANTS = sweep->args;
+
+    return state;
+}
+
+void meanReversionVary(struct SimState *state, int variant) {
+    // Only the factors differ between cells, and none are used until the warm-up is over
+    struct MeanReversionArgs *args = (struct MeanReversionArgs *)orderAux(state, findCustomOrder(state, meanReversion));
+    args->buyFactor  = MR_VARIANTS[variant].buyFactor;
+    args->sellFactor = MR_VARIANTS[variant].sellFactor;
+    args->stopFactor = MR_VARIANTS[variant].stopFactor;
+}
@@ -6,11 +6,10 @@
 #include "load_prices.h"
 #include "execution.h"
 #include "rng.h"
+#include "screening.h"
 
 #include "strategies.h"
 
-#define RANDOM_SYMBOL_BUFFER_SIZE 8192
-
 enum OrderStatus basicStrat1(struct SimState *state, struct Order *order) {
     static const int MAX_ITERS = 5;
     static int iters = 0;
@@ -18,10 +17,10 @@ enum OrderStatus basicStrat1(struct SimState *state, struct Order *order) {
     static long price;
 
     if (!havePosition) {
-        price = state->priceFn(&(order->symbol), state->time);
+        price = statePrice(state, &(order->symbol));
         buy(state, &(order->symbol), order->quantity);
         havePosition = 1;
-    } else if (state->priceFn(&(order->symbol), state->time) > price) {
+    } else if (statePrice(state, &(order->symbol)) > price) {
         sell(state, &(order->symbol), order->quantity);
         havePosition = 0;
         ++iters;
@@ -34,7 +33,7 @@ enum OrderStatus basicStrat1(struct SimState *state, struct Order *order) {
 }
 
 enum OrderStatus timeHorizon(struct SimState *state, struct Order *order) {
-    struct TimeHorizonArgs *aux = (struct TimeHorizonArgs*)order->aux;
+    struct TimeHorizonArgs *aux = (struct TimeHorizonArgs *)orderAux(state, order);
     if (!aux->cutoff) {
         aux->cutoff = state->time + aux->offset;
     }
@@ -51,14 +50,15 @@ enum OrderStatus timeHorizon(struct SimState *state, struct Order *order) {
         }
         return None;
     } else {
-        // Otherwise, don't do anything at all.
+        // Otherwise, don't do anything at all until the cutoff.
+        order->wakeTime = aux->cutoff;
         return Active;
     }
 }
 
 enum OrderStatus meanReversion(struct SimState *state, struct Order *order) {
-    struct MeanReversionArgs *aux = (struct MeanReversionArgs*)order->aux;
-    long price = state->priceFn(&(order->symbol), state->time);
+    struct MeanReversionArgs *aux = (struct MeanReversionArgs *)orderAux(state, order);
+    long price = statePrice(state, &(order->symbol));
 
     aux->ema = aux->ema * aux->emaDiscount + price * (1 - aux->emaDiscount);
     if (aux->initialSamples) {
@@ -85,21 +85,15 @@ enum OrderStatus portfolioRebalance(struct SimState *state, struct Order *order)
     long values[REBALANCING_MAX_SYMBOLS];
     long buyingPower = state->cash;
 
-    struct PortfolioRebalanceArgs *args = (struct PortfolioRebalanceArgs *) order->aux;
+    struct PortfolioRebalanceArgs *args = (struct PortfolioRebalanceArgs *)orderAux(state, order);
 
     // Get current prices, current values for each asset class,
     //   and tally total available value
     for (int i = 0; i < args->symbolsUsed; ++i) {
-        currentPrices[i] = state->priceFn(args->assets + i, state->time);
-        quantities[i] = 0;
-        values[i] = 0;
-        for (int j = 0; j < state->maxActivePosition; ++j) {
-            if (state->positions[j].symbol.id == args->assets[i].id) {
-                quantities[i] = state->positions[j].quantity;
-                values[i]     = quantities[i] * currentPrices[i];
-                break;
-            }
-        }
+        currentPrices[i] = statePrice(state, args->assets + i);
+        const struct Position *position = findPosition(state, args->assets + i);
+        quantities[i] = (position ? position->quantity : 0);
+        values[i]     = quantities[i] * currentPrices[i];
         buyingPower += values[i];
     }
 
@@ -128,13 +122,15 @@ enum OrderStatus portfolioRebalance(struct SimState *state, struct Order *order)
 }
 
 enum OrderStatus randomPortfolioRebalance(struct SimState *state, struct Order *order) {
-    struct RandomPortfolioRebalanceArgs *args = (struct RandomPortfolioRebalanceArgs *) order->aux;
+    struct RandomPortfolioRebalanceArgs *args = (struct RandomPortfolioRebalanceArgs *)orderAux(state, order);
 
     union Symbol *symbols = randomSymbols(args->numSymbols, state->time, 0);
+    preloadHistoricalPrices(symbols, args->numSymbols, state->time, state->time);
 
     union Symbol prSymbol;
     strncpy(prSymbol.name, "R-REBAL", SYMBOL_LENGTH);
-    struct PortfolioRebalanceArgs *prArgs = (struct PortfolioRebalanceArgs *)makeCustomOrder(state, &prSymbol, 1, portfolioRebalance)->aux;
+    struct PortfolioRebalanceArgs *prArgs = (struct PortfolioRebalanceArgs *)orderAux(state,
+        makeCustomOrder(state, &prSymbol, 1, portfolioRebalance, sizeof(struct PortfolioRebalanceArgs)));
     prArgs->symbolsUsed = args->numSymbols;
     prArgs->maxAssetValue = args->maxAssetValue;
     for (int i = 0; i < args->numSymbols; ++i) {
@@ -147,133 +143,54 @@ enum OrderStatus randomPortfolioRebalance(struct SimState *state, struct Order *
     return None;
 }
 
-/**
- * Calculates standard deviation divided by mean, to normalize
- */
-double volatility(union Symbol *symbol, time_t start, time_t end, time_t sampleInterval) {
-    double mean = 0.0;
-    int k = 1;
-    for (time_t t = start; t < end; t += sampleInterval, ++k) {
-        mean += (getHistoricalPrice(symbol, t) - mean) / k;
-    }
-
-    double meanSquares = 0.0;
-    long p;
-    k = 1;
-    for (time_t t = start; t < end; t += sampleInterval, ++k) {
-        p = getHistoricalPrice(symbol, t);
-        meanSquares += (((p - mean) * (p - mean)) - meanSquares) / k;
-    }
-    return sqrt(meanSquares) / mean;
-}
-
 enum OrderStatus volatilityPortfolioRebalance(struct SimState *state, struct Order *order) {
-    struct VolatilityPortfolioRebalanceArgs *args = (struct VolatilityPortfolioRebalanceArgs *) order->aux;
+    struct VolatilityPortfolioRebalanceArgs *args = (struct VolatilityPortfolioRebalanceArgs *)orderAux(state, order);
 
     union Symbol prSymbol;
     strncpy(prSymbol.name, "V-REBAL", SYMBOL_LENGTH);
-    struct PortfolioRebalanceArgs *prArgs = (struct PortfolioRebalanceArgs *)makeCustomOrder(state, &prSymbol, 1, portfolioRebalance)->aux;
+    struct PortfolioRebalanceArgs *prArgs = (struct PortfolioRebalanceArgs *)orderAux(state,
+        makeCustomOrder(state, &prSymbol, 1, portfolioRebalance, sizeof(struct PortfolioRebalanceArgs)));
     prArgs->maxAssetValue = args->maxAssetValue;
-    prArgs->symbolsUsed   = 0;
-
-    int attempts = 0;
-    int duplicate;
-
-    while (prArgs->symbolsUsed < args->numSymbols) {
-        int sampleSize = 3*args->numSymbols;
-        union Symbol *symbols = randomSymbols(sampleSize, state->time - args->history, state->time);
-        for (int i = 0; i < sampleSize && prArgs->symbolsUsed < args->numSymbols; ++i) {
-            duplicate = 0;
-            for (int j = 0; j < prArgs->symbolsUsed; ++j) {
-                if (symbols[i].id == prArgs->assets[j].id) {
-                    duplicate = 1;
-                    break;
-                }
-            }
-            if (duplicate) continue;
+    prArgs->symbolsUsed   = args->numSymbols;
 
-            double v = volatility(symbols + i, state->time - args->history, state->time, args->sampleFrequency);
-            if (abs(v - args->targetVolatility) < args->epsilon * args->targetVolatility) {
-                prArgs->assets[prArgs->symbolsUsed].id = symbols[i].id;
-                prArgs->weights[prArgs->symbolsUsed] = 1.0 / args->numSymbols;
-                prArgs->symbolsUsed++;
-            }
-        }
-        free(symbols);
-        ++attempts;
-        if (attempts > 10) {
-            fprintf(stderr, "Failed 10 attempts to compile %d assets with volatility %.1lf%% +/- %.0lf%%, time %ld\n",
-                args->numSymbols, args->targetVolatility*100, args->epsilon*100, state->time
-                );
-            exit(1);
-        }
+    union Symbol *symbols = screenSymbols(ScreenVolatility, args->history, state->time,
+        args->targetVolatility, args->epsilon, args->numSymbols);
+    for (int i = 0; i < args->numSymbols; ++i) {
+        prArgs->assets[i].id = symbols[i].id;
+        prArgs->weights[i]   = 1.0 / args->numSymbols;
     }
+    free(symbols);
 
     return None;
 }
 
-double meanPrice(union Symbol *symbol, time_t start, time_t end, time_t sampleInterval) {
-    double mean = 0.0;
-    int k = 1;
-    for (time_t t = start; t < end; t += sampleInterval, ++k) {
-        mean += (getHistoricalPrice(symbol, t) - mean) / k;
-    }
-    return mean;
-}
-
 enum OrderStatus meanPricePortfolioRebalance(struct SimState *state, struct Order *order) {
-    struct MeanPricePortfolioRebalanceArgs *args = (struct MeanPricePortfolioRebalanceArgs *) order->aux;
+    struct MeanPricePortfolioRebalanceArgs *args = (struct MeanPricePortfolioRebalanceArgs *)orderAux(state, order);
 
     union Symbol prSymbol;
     strncpy(prSymbol.name, "MP-REBAL", SYMBOL_LENGTH);
-    struct PortfolioRebalanceArgs *prArgs = (struct PortfolioRebalanceArgs *)makeCustomOrder(state, &prSymbol, 1, portfolioRebalance)->aux;
+    struct PortfolioRebalanceArgs *prArgs = (struct PortfolioRebalanceArgs *)orderAux(state,
+        makeCustomOrder(state, &prSymbol, 1, portfolioRebalance, sizeof(struct PortfolioRebalanceArgs)));
     prArgs->maxAssetValue = args->maxAssetValue;
-    prArgs->symbolsUsed   = 0;
-
-    int attempts = 0;
-    int duplicate;
-
-    while (prArgs->symbolsUsed < args->numSymbols) {
-        int sampleSize = 5*args->numSymbols;
-        union Symbol *symbols = randomSymbols(sampleSize, state->time - args->history, state->time);
-        for (int i = 0; i < sampleSize && prArgs->symbolsUsed < args->numSymbols; ++i) {
-            duplicate = 0;
-            for (int j = 0; j < prArgs->symbolsUsed; ++j) {
-                if (symbols[i].id == prArgs->assets[j].id) {
-                    duplicate = 1;
-                    break;
-                }
-            }
-            if (duplicate) {
-                continue;
-            }
+    prArgs->symbolsUsed   = args->numSymbols;
 
-            double p = meanPrice(symbols + i, state->time - args->history, state->time, args->sampleFrequency);
-            if (abs(p - args->targetPrice) < args->epsilon * args->targetPrice) {
-                prArgs->assets[prArgs->symbolsUsed].id = symbols[i].id;
-                prArgs->weights[prArgs->symbolsUsed] = 1.0 / args->numSymbols;
-                prArgs->symbolsUsed++;
-            }
-        }
-        free(symbols);
-        ++attempts;
-        if (attempts > 10) {
-            fprintf(stderr, "Failed 10 attempts to compile %d assets with mean price $%.2lf +/- %.0lf%%, time %ld\n",
-                args->numSymbols, args->targetPrice/(double)DOLLAR, args->epsilon*100, state->time
-                );
-            exit(1);
-        }
+    union Symbol *symbols = screenSymbols(ScreenMeanPrice, args->history, state->time,
+        args->targetPrice, args->epsilon, args->numSymbols);
+    for (int i = 0; i < args->numSymbols; ++i) {
+        prArgs->assets[i].id = symbols[i].id;
+        prArgs->weights[i]   = 1.0 / args->numSymbols;
     }
+    free(symbols);
 
     return None;
 }
 
 enum OrderStatus buyBalanced(struct SimState *state, struct Order *order) {
-    struct BuyBalancedArgs *args = (struct BuyBalancedArgs *)order->aux;
+    struct BuyBalancedArgs *args = (struct BuyBalancedArgs *)orderAux(state, order);
     const long value = (long)(args->totalValue * REBALANCING_BUFFER_FACTOR);
     long price;
     for (int i = 0; i < args->symbolsUsed; ++i) {
-        price = state->priceFn(args->assets + i, state->time);
+        price = statePrice(state, args->assets + i);
         buy(state, args->assets + i, (int)round( (args->weights[i] * value) / (args->symbolsUsed * price) ));
     }
     return None;
@@ -284,18 +201,20 @@ enum OrderStatus buyBalanced(struct SimState *state, struct Order *order) {
  */
 
 union Symbol *randomSymbols(int n, time_t requiredDataStart, time_t requiredDataEnd) {
-    int numSymbols, numViableSymbols = 0;
-    const union Symbol *allSymbols = getAllSymbols(&numSymbols);
-    union Symbol viableSymbols[RANDOM_SYMBOL_BUFFER_SIZE];
-    int i;
-
-    // Filter all symbols down to viable symbols
-    time_t start, end;
-    for (i = 0; i < numSymbols; ++i) {
-        if ( getHistoricalPriceTimePeriod(allSymbols + i, &start, &end) &&
-            (!requiredDataStart || start <= requiredDataStart) &&
-            (!requiredDataEnd   || end   >= requiredDataEnd  ) ) {
-            viableSymbols[numViableSymbols++].id = allSymbols[i].id;
+    // Symbols with data early enough are a prefix of the start-ordered index
+    int numCandidates, numViableSymbols;
+    const struct SymbolPeriod *candidates = getSymbolsByStart(requiredDataStart, &numCandidates);
+
+    // Of those, filter down to symbols with data late enough, if that's required
+    int *viableSymbols = NULL;
+    numViableSymbols = numCandidates;
+    if (requiredDataEnd) {
+        viableSymbols = malloc(sizeof(int) * (numCandidates ? numCandidates : 1));
+        numViableSymbols = 0;
+        for (int i = 0; i < numCandidates; ++i) {
+            if (candidates[i].end >= requiredDataEnd) {
+                viableSymbols[numViableSymbols++] = i;
+            }
         }
     }
     if (numViableSymbols < n) {
@@ -304,22 +223,13 @@ union Symbol *randomSymbols(int n, time_t requiredDataStart, time_t requiredData
     }
 
     union Symbol *chosenSymbols = malloc(sizeof(union Symbol) * n);
-    int symbolsChosen = 0;
-
-    while (symbolsChosen < n) {
-        // Choose a random index for available symbols
-        i = (int)(( (long)tsRand() * numViableSymbols ) / RAND_MAX );
-        // Reject if already chosen:
-        for (int j = 0; j < symbolsChosen; ++j) {
-            if (chosenSymbols[j].id == viableSymbols[i].id) {
-                i = -1;
-                break;
-            }
-        }
-        if (i >= 0) {
-            chosenSymbols[symbolsChosen++].id = viableSymbols[i].id;
-        }
+    int *chosen = malloc(sizeof(int) * n);
+    tsRandSample(n, numViableSymbols, chosen);
+    for (int i = 0; i < n; ++i) {
+        chosenSymbols[i].id = candidates[viableSymbols ? viableSymbols[chosen[i]] : chosen[i]].symbol.id;
     }
+    free(chosen);
+    free(viableSymbols);
 
     return chosenSymbols;
 }
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "batch_execution.h"
+#include "execution.h"
+#include "load_prices.h"
+
+#include "strategy_sweep.h"
+
+// Added to and subtracted from a non-negative double below this, rounds it to a whole number
+#define ROUNDING_SHIFT 0x1p52
+
+/**
+ * Forward Declarations
+ */
+
+long *sweepStartTimes(struct MeanReversionSweep *sweep, struct SimState *baseScenario, const time_t *startTimes, int n);
+void *runSweepStarts(void *args);
+void initScalarVariant(struct SimState *state, const struct MeanReversionSweep *sweep, struct SimState *baseScenario, int variant);
+void stepMeanReversionSweep(struct MeanReversionSweep *sweep, long price);
+void stepMeanReversionColumns(int n, long price,
+    const double *restrict emaDiscount, const double *restrict buyFactor,
+    const double *restrict sellFactor, const double *restrict stopFactor,
+    double *restrict ema, double *restrict initialSamples,
+    double *restrict boughtPrice, double *restrict boughtQuantity, double *restrict cash);
+double floorDivide(double x, double d);
+
+/**
+ * Initializers & Modifiers
+ */
+
+struct MeanReversionSweep *makeMeanReversionSweep(const union Symbol *symbol, const struct MeanReversionArgs *args, int n, time_t horizon) {
+    if (n <= 0) {
+        fprintf(stderr, "Invalid sweep of %d variants\n", n);
+        exit(1);
+    }
+
+    struct MeanReversionSweep *sweep = malloc(sizeof(*sweep));
+    const long perLine = SWEEP_ALIGNMENT / sizeof(double);
+    const long stride  = (n + perLine - 1) / perLine * perLine;
+    double *columns    = aligned_alloc(SWEEP_ALIGNMENT, sizeof(double) * stride * 9);
+    sweep->args        = malloc(sizeof(struct MeanReversionArgs) * n);
+    if (!columns || !sweep->args) {
+        fprintf(stderr, "Cannot allocate sweep of %d variants\n", n);
+        exit(1);
+    }
+    sweep->emaDiscount    = columns;
+    sweep->ema            = sweep->emaDiscount + stride;
+    sweep->buyFactor      = sweep->ema + stride;
+    sweep->sellFactor     = sweep->buyFactor + stride;
+    sweep->stopFactor     = sweep->sellFactor + stride;
+    sweep->initialSamples = sweep->stopFactor + stride;
+    sweep->boughtPrice    = sweep->initialSamples + stride;
+    sweep->boughtQuantity = sweep->boughtPrice + stride;
+    sweep->cash           = sweep->boughtQuantity + stride;
+
+    sweep->symbol.id = symbol->id;
+    sweep->horizon   = horizon;
+    sweep->n         = n;
+    for (int k = 0; k < n; ++k) {
+        sweep->args[k] = args[k];
+    }
+    return sweep;
+}
+
+void freeMeanReversionSweep(struct MeanReversionSweep *sweep) {
+    free(sweep->emaDiscount); // start of the column block
+    free(sweep->args);
+    free(sweep);
+}
+
+void runMeanReversionSweep(struct MeanReversionSweep *sweep, struct SimState *state) {
+    for (int k = 0; k < sweep->n; ++k) {
+        sweep->emaDiscount[k]    = sweep->args[k].emaDiscount;
+        sweep->ema[k]            = sweep->args[k].ema;
+        sweep->buyFactor[k]      = sweep->args[k].buyFactor;
+        sweep->sellFactor[k]     = sweep->args[k].sellFactor;
+        sweep->stopFactor[k]     = sweep->args[k].stopFactor;
+        sweep->initialSamples[k] = sweep->args[k].initialSamples;
+        sweep->boughtPrice[k]    = sweep->args[k].boughtPrice;
+        sweep->boughtQuantity[k] = sweep->args[k].boughtQuantity;
+        sweep->cash[k]           = state->cash;
+    }
+
+    // As timeHorizon, which sets its cutoff on its first step, and acts before meanReversion does
+    state->time = nextStepTime(state);
+    const time_t cutoff = state->time + sweep->horizon;
+    while (state->time < cutoff) {
+        stepMeanReversionSweep(sweep, state->priceFn(&sweep->symbol, state->time));
+        state->time = nextStepTime(state);
+    }
+
+    // Liquidate, as timeHorizon's sell orders do
+    const long price = state->priceFn(&sweep->symbol, state->time);
+    double proceeds;
+    for (int k = 0; k < sweep->n; ++k) {
+        proceeds = sweep->boughtQuantity[k] * price;
+        proceeds -= floorDivide(proceeds * TRANSACTION_FEE, 10000);
+        sweep->cash[k] += proceeds;
+        sweep->boughtQuantity[k] = 0;
+    }
+}
+
+/**
+ * Testing
+ */
+
+long *randomizedStartSweep(struct MeanReversionSweep *sweep, const struct RandomizedStartArgs *args) {
+    time_t startTimes[args->n];
+    for (int i = 0; i < args->n; ++i) {
+        startTimes[i] = randomStartTime(args);
+    }
+    return sweepStartTimes(sweep, args->baseScenario, startTimes, args->n);
+}
+
+long checkMeanReversionSweep(struct MeanReversionSweep *sweep, const struct RandomizedStartArgs *args) {
+    time_t startTimes[args->n];
+    for (int i = 0; i < args->n; ++i) {
+        startTimes[i] = randomStartTime(args);
+    }
+    long *swept = sweepStartTimes(sweep, args->baseScenario, startTimes, args->n);
+
+    long mismatches = 0;
+    struct SimState *state = malloc(sizeof(*state));
+    for (int k = 0; k < sweep->n; ++k) {
+        for (int i = 0; i < args->n; ++i) {
+            initScalarVariant(state, sweep, args->baseScenario, k);
+            state->time = startTimes[i];
+            runScenario(state);
+            if (state->cash != swept[k * args->n + i]) {
+                db_printf("Variant %d from %ld: scalar run ends with %ld, sweep with %ld", k, startTimes[i], state->cash, swept[k * args->n + i]);
+                ++mismatches;
+            }
+        }
+    }
+    free(state);
+    free(swept);
+    return mismatches;
+}
+
+/**
+ * Helpers
+ */
+
+struct SweepStartsArgs {
+    struct MeanReversionSweep *sweep; // this worker's own columns
+    struct SimState *baseScenario;
+    const time_t *startTimes;
+    long *results;
+    int n, first, stride;
+};
+
+/**
+ * Runs sweep from each of the n startTimes, spread across NUM_WORKERS threads.
+ * Each worker steps its own copy of the columns, so results don't depend on how starts are shared out.
+ * Returns final cash variant-major, as randomizedStartSweep does.
+ */
+long *sweepStartTimes(struct MeanReversionSweep *sweep, struct SimState *baseScenario, const time_t *startTimes, int n) {
+    historicalPriceInit();
+
+    long *results = malloc(sizeof(long) * sweep->n * n);
+    pthread_t threads[NUM_WORKERS];
+    struct SweepStartsArgs ssArgs[NUM_WORKERS];
+    for (int w = 0; w < NUM_WORKERS; ++w) {
+        ssArgs[w].sweep        = makeMeanReversionSweep(&sweep->symbol, sweep->args, sweep->n, sweep->horizon);
+        ssArgs[w].baseScenario = baseScenario;
+        ssArgs[w].startTimes   = startTimes;
+        ssArgs[w].results      = results;
+        ssArgs[w].n            = n;
+        ssArgs[w].first        = w;
+        ssArgs[w].stride       = NUM_WORKERS;
+        // Workers only read prices, so need no random number generator of their own
+        if (pthread_create(threads + w, NULL, runSweepStarts, ssArgs + w)) {
+            fprintf(stderr, "Error creating sweep threads.\n");
+            exit(1);
+        }
+    }
+    for (int w = 0; w < NUM_WORKERS; ++w) {
+        pthread_join(threads[w], NULL);
+        freeMeanReversionSweep(ssArgs[w].sweep);
+    }
+    return results;
+}
+
+void *runSweepStarts(void *args) {
+    struct SweepStartsArgs *ssArgs = (struct SweepStartsArgs *)args;
+    struct MeanReversionSweep *sweep = ssArgs->sweep;
+    struct SimState *state = malloc(sizeof(*state));
+    copySimState(state, ssArgs->baseScenario);
+    for (int i = ssArgs->first; i < ssArgs->n; i += ssArgs->stride) {
+        state->time = ssArgs->startTimes[i];
+        runMeanReversionSweep(sweep, state);
+        for (int k = 0; k < sweep->n; ++k) {
+            ssArgs->results[k * ssArgs->n + i] = (long)sweep->cash[k];
+        }
+    }
+    free(state);
+    return NULL;
+}
+
+/**
+ * Sets up state as the scalar run that sweep's variant stands in for:
+ * baseScenario's cash, prices and step settings, with a timeHorizon order then a meanReversion order.
+ */
+void initScalarVariant(struct SimState *state, const struct MeanReversionSweep *sweep, struct SimState *baseScenario, int variant) {
+    initSimState(state, baseScenario->time);
+    state->priceFn    = baseScenario->priceFn;
+    state->cash       = baseScenario->cash;
+    state->stepSize   = baseScenario->stepSize;
+    state->stepSymbol = baseScenario->stepSymbol;
+
+    union Symbol thSymbol;
+    strncpy(thSymbol.name, "HRZN", SYMBOL_LENGTH);
+    struct TimeHorizonArgs *thArgs = (struct TimeHorizonArgs *)orderAux(state,
+        makeCustomOrder(state, &thSymbol, 1, timeHorizon, sizeof(struct TimeHorizonArgs)));
+    thArgs->offset = sweep->horizon;
+    thArgs->cutoff = 0;
+
+    union Symbol mrSymbol = sweep->symbol;
+    struct MeanReversionArgs *mrArgs = (struct MeanReversionArgs *)orderAux(state,
+        makeCustomOrder(state, &mrSymbol, 1, meanReversion, sizeof(struct MeanReversionArgs)));
+    *mrArgs = sweep->args[variant];
+}
+
+void stepMeanReversionSweep(struct MeanReversionSweep *sweep, long price) {
+    stepMeanReversionColumns(sweep->n, price,
+        sweep->emaDiscount, sweep->buyFactor, sweep->sellFactor, sweep->stopFactor,
+        sweep->ema, sweep->initialSamples, sweep->boughtPrice, sweep->boughtQuantity, sweep->cash);
+}
+
+/**
+ * One step of meanReversion, and the buy or sell order it places, for each of n variants at once.
+ * Decisions are made as masks and applied with selects rather than branches, so both loops vectorize.
+ * Every column holds doubles, money and quantities as whole numbers well below 2^52,
+ * so the arithmetic is exact and gives the same results as meanReversion's longs.
+ * Columns come in as restrict parameters, so the compiler knows that none of them overlap,
+ * and floating-point exceptions are never checked, so it may compute both sides of each select.
+ */
+__attribute__ ((optimize ("no-trapping-math")))
+void stepMeanReversionColumns(int n, long price,
+    const double *restrict emaDiscount, const double *restrict buyFactor,
+    const double *restrict sellFactor, const double *restrict stopFactor,
+    double *restrict ema, double *restrict initialSamples,
+    double *restrict boughtPrice, double *restrict boughtQuantity, double *restrict cash) {
+    for (int k = 0; k < n; ++k) {
+        ema[k] = ema[k] * emaDiscount[k] + price * (1 - emaDiscount[k]);
+    }
+
+    // Same for every variant: what meanReversion sizes each share's cost at
+    const double shareCost = price + 1 + price * TRANSACTION_FEE / 10000;
+    const double fee = TRANSACTION_FEE;
+    int acting, flat, buy, sell;
+    double quantity, sold, cost, proceeds;
+    for (int k = 0; k < n; ++k) {
+        acting = (initialSamples[k] == 0);
+        flat   = (boughtQuantity[k] == 0);
+        buy  = acting & flat & (price < buyFactor[k] * ema[k]) & (price < cash[k]);
+        sell = acting & !flat & ((price > sellFactor[k] * ema[k]) | (price < stopFactor[k] * boughtPrice[k]));
+        initialSamples[k] -= !acting;
+
+        quantity = floorDivide(cash[k], shareCost);
+        quantity = (buy ? quantity : 0);
+        cost     = quantity * price;
+        cost    += floorDivide(cost * fee, 10000);
+        sold     = (sell ? boughtQuantity[k] : 0);
+        proceeds = sold * price;
+        proceeds -= floorDivide(proceeds * fee, 10000);
+
+        cash[k]          += proceeds - cost;
+        boughtPrice[k]    = (buy ? price : boughtPrice[k]);
+        // Only buys when flat, so this sets quantity on buying and clears it on selling
+        boughtQuantity[k] += quantity - sold;
+    }
+}
+
+/**
+ * Returns x / d rounded down, as integer division would, for whole numbers 0 <= x < 2^52 and d > 0.
+ * Rounds the quotient to the nearest whole number, then steps back one if that overshot.
+ * Uses no conversions to integers, which have no vector form for 64-bit values on plain x86-64.
+ */
+__attribute__ ((optimize ("no-trapping-math")))
+double floorDivide(double x, double d) {
+    const double q = x / d + ROUNDING_SHIFT - ROUNDING_SHIFT;
+    return (q * d > x ? q - 1 : q);
+}
@@ -8,6 +8,7 @@
 #include <time.h>
 
 #include "batch_execution.h"
+#include "execution.h"
 #include "rng.h"
 #include "display_tools.h"
 
@@ -44,7 +45,7 @@ void *randomizedStart(struct RandomizedStartArgs *args, void **resultsEnd) {
     struct SimState *state = malloc(sizeof(*state));
     copySimState(state, args->baseScenario);
     for (int i = 0; i < args->n; ++i) {
-        state->time = args->minStart + (time_t)( tsRand() * (double)(args->maxStart - args->minStart) / RAND_MAX );
+        state->time = randomStartTime(args);
         addJob(state);
     }
 
@@ -66,7 +67,7 @@ void *randomizedStart(struct RandomizedStartArgs *args, void **resultsEnd) {
 void **randomizedStartComparison(struct RandomizedStartArgs *args, int numScenarios, void ***resultEnds) {
     time_t startTimes[args->n];
     for (int i = 0; i < args->n; ++i) {
-        startTimes[i] = args->minStart + (time_t)( tsRand() * (double)(args->maxStart - args->minStart) / RAND_MAX );
+        startTimes[i] = randomStartTime(args);
     }
     void **output     = malloc(sizeof(void *) * numScenarios);
     void **outputEnds = malloc(sizeof(void *) * numScenarios);
@@ -130,6 +131,143 @@ long *randomizedStartDelta(struct RandomizedStartArgs *args, struct SimState *ch
     return output;
 }
 
+struct WarmUpArgs {
+    struct SimState *states;
+    int n, first, stride;
+    long steps;
+    unsigned int seed;
+};
+void *warmUpScenarios(void *args) {
+    struct WarmUpArgs *wuArgs = (struct WarmUpArgs *)args;
+    tsRandBindThread(wuArgs->seed);
+    for (int i = wuArgs->first; i < wuArgs->n; i += wuArgs->stride) {
+        runScenarioSteps(wuArgs->states + i, wuArgs->steps);
+    }
+    return NULL;
+}
+void **randomizedStartForked(struct RandomizedStartArgs *args, long warmUpSteps, int numVariants,
+    void (*vary)(struct SimState *state, int variant), void ***resultEnds) {
+    struct SimState *warmStates = malloc(sizeof(struct SimState) * args->n);
+    for (int i = 0; i < args->n; ++i) {
+        initSimState(warmStates + i, 0);
+        copySimState(warmStates + i, args->baseScenario);
+        warmStates[i].time = randomStartTime(args);
+    }
+
+    initJobQueue();
+
+    // Warm up from every start time once, spread across the workers
+    pthread_t warmThreads[NUM_WORKERS];
+    struct WarmUpArgs wuArgs[NUM_WORKERS];
+    for (int w = 0; w < NUM_WORKERS; ++w) {
+        wuArgs[w].states = warmStates;
+        wuArgs[w].n      = args->n;
+        wuArgs[w].first  = w;
+        wuArgs[w].stride = NUM_WORKERS;
+        wuArgs[w].steps  = warmUpSteps;
+        // Seeded as the job queue's workers are, and each always warms up the same states,
+        // so any draws during warm-up are the same from run to run
+        wuArgs[w].seed   = tsRandThreadSeed();
+        if (pthread_create(warmThreads + w, NULL, warmUpScenarios, wuArgs + w)) {
+            fprintf(stderr, "Error creating warm-up threads.\n");
+            exit(1);
+        }
+    }
+    for (int w = 0; w < NUM_WORKERS; ++w) {
+        pthread_join(warmThreads[w], NULL);
+    }
+
+    void **output     = malloc(sizeof(void *) * numVariants);
+    void **outputEnds = malloc(sizeof(void *) * numVariants);
+
+    pthread_t resultThread;
+    struct SimState *state = malloc(sizeof(*state));
+    void *tempOut, *tempOutEnd;
+    int sz;
+    struct rsResultsArgs *resultsArgs = malloc(sizeof(*resultsArgs));
+    for (int j = 0; j < numVariants; ++j) {
+        resultsArgs->n   = args->n;
+        resultsArgs->dcs = args->dcs;
+        pthread_create(&resultThread, NULL, randomizedStartCollectResults, resultsArgs);
+        // Fork every warmed-up state into variant j
+        for (int i = 0; i < args->n; ++i) {
+            copySimState(state, warmStates + i);
+            vary(state, j);
+            addJob(state);
+        }
+        pthread_join(resultThread, NULL);
+        tempOut = args->dcs->results(&tempOutEnd);
+        sz = (char*)tempOutEnd - (char*)tempOut;
+        output[j] = malloc(sz);
+        memcpy(output[j], tempOut, sz);
+        outputEnds[j] = (char*)output[j] + sz;
+        args->dcs->reset();
+    }
+
+    free(resultsArgs);
+    free(state);
+    free(warmStates);
+    *resultEnds = outputEnds;
+    return output;
+}
+
+int compareLongs(const void *a, const void *b) {
+    const long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+long checkRandomizedStartForked(struct RandomizedStartArgs *args, long warmUpSteps, int numVariants,
+    void (*vary)(struct SimState *state, int variant)) {
+    // Unforked, each variant is set up before it starts
+    struct SimState *scenarios = malloc(sizeof(struct SimState) * numVariants);
+    for (int j = 0; j < numVariants; ++j) {
+        initSimState(scenarios + j, 0);
+        copySimState(scenarios + j, args->baseScenario);
+        vary(scenarios + j, j);
+    }
+    struct RandomizedStartArgs forkedArgs = *args;
+    forkedArgs.dcs = &FinalCashDCS;
+    struct RandomizedStartArgs unforkedArgs = forkedArgs;
+    unforkedArgs.baseScenario = scenarios;
+
+    // Reseed before each, so both draw the same start times
+    const unsigned int seed = tsRandThreadSeed();
+    initJobQueue();
+    void **forkedEnds, **unforkedEnds;
+    tsRandBindThread(seed);
+    long **forked   = (long **)randomizedStartForked(&forkedArgs, warmUpSteps, numVariants, vary, &forkedEnds);
+    tsRandBindThread(seed);
+    long **unforked = (long **)randomizedStartComparison(&unforkedArgs, numVariants, &unforkedEnds);
+
+    // Results come back in the order runs finish, so compare them sorted
+    long mismatches = 0;
+    for (int j = 0; j < numVariants; ++j) {
+        qsort(forked[j], args->n, sizeof(long), compareLongs);
+        qsort(unforked[j], args->n, sizeof(long), compareLongs);
+        for (int i = 0; i < args->n; ++i) {
+            if (forked[j][i] != unforked[j][i]) {
+                db_printf("Variant %d: forked run ends with %ld, unforked with %ld", j, forked[j][i], unforked[j][i]);
+                ++mismatches;
+            }
+        }
+        free(forked[j]);
+        free(unforked[j]);
+    }
+    free(forked);
+    free(forkedEnds);
+    free(unforked);
+    free(unforkedEnds);
+    free(scenarios);
+    return mismatches;
+}
+
+time_t randomStartTime(const struct RandomizedStartArgs *args) {
+    time_t start = args->minStart + (time_t)( tsRand() * (double)(args->maxStart - args->minStart) / RAND_MAX );
+    if (args->startGranularity) {
+        start -= start % args->startGranularity;
+    }
+    return start;
+}
+
 /**
  * Optimization / Parameter Testing
  */
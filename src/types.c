@@ -3,6 +3,8 @@
 
 #include "types.h"
 
+#define PRICE_MEMO_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+
 const time_t SECOND = 1;
 const time_t MINUTE = 60;
 const time_t HOUR   = 3600;
@@ -10,16 +12,22 @@ const time_t DAY    = 86400;
 const time_t WEEK   = 604800;
 const time_t MONTH  = 2592000;
 const time_t YEAR   = 31536000;
+const time_t DEFAULT_STEP_SIZE = 43200; // 12 hours
 const long CENT = 100;
 const long DOLLAR = 10000;
 
 void initSimState(struct SimState *state, time_t startTime) {
     state->time = startTime;
+    state->stepSize = DEFAULT_STEP_SIZE;
+    state->stepSymbol.id = 0;
     state->maxActiveOrder = 0;
     state->maxActivePosition = 0;
     state->cash = 0;
     state->priceFn = NULL;
+    state->priceMemoFn = NULL; // cleared on first use
+    state->orderAuxUsed = 0;
     memset(state->aux, 0, SIMSTATE_AUX_BYTES);
+    memset(state->positionIndex, 0, POSITION_INDEX_SIZE);
 
     for (int i = 0; i < MAX_ORDERS; ++i) {
         initOrder( &(state->orders[i]) );
@@ -35,7 +43,9 @@ void initOrder(struct Order *order) {
     order->customFn = NULL;
     order->symbol.id = 0;
     order->quantity = 0;
-    memset(order->aux, 0, ORDER_AUX_BYTES);
+    order->auxOffset = 0;
+    order->auxSize = 0;
+    order->wakeTime = 0;
 }
 
 void initPosition(struct Position *position) {
@@ -47,21 +57,53 @@ void copySimState(struct SimState *dest, struct SimState *src) {
     memcpy(dest->aux, src->aux, SIMSTATE_AUX_BYTES);
     memcpy(dest->orders, src->orders, sizeof(struct Order) * src->maxActiveOrder);
     memcpy(dest->positions, src->positions, sizeof(struct Position) * src->maxActivePosition);
+    memcpy(dest->positionIndex, src->positionIndex, POSITION_INDEX_SIZE);
+    memcpy(dest->orderAux, src->orderAux, src->orderAuxUsed);
+    dest->orderAuxUsed = src->orderAuxUsed;
     dest->priceFn = src->priceFn;
+    dest->priceMemoFn = NULL; // dest may be uninitialized, so its memo is cleared on first use
     dest->cash = src->cash;
     dest->maxActiveOrder = src->maxActiveOrder;
     dest->maxActivePosition = src->maxActivePosition;
     dest->time = src->time;
+    dest->stepSize = src->stepSize;
+    dest->stepSymbol.id = src->stepSymbol.id;
 }
 
 long worth(struct SimState *state) {
     long worth = state->cash;
     for (int i = 0; i < state->maxActivePosition; ++i) {
-        worth += state->positions[i].quantity * state->priceFn(&(state->positions[i].symbol), state->time);
+        worth += state->positions[i].quantity * statePrice(state, &(state->positions[i].symbol));
     }
     return worth;
 }
 
+long statePrice(struct SimState *state, const union Symbol *symbol) {
+    if (state->priceMemoFn != state->priceFn) {
+        // Prices from another function, or left over from initSimState
+        for (int i = 0; i < PRICE_MEMO_SIZE; ++i) {
+            state->priceMemo[i].time = state->time - 1;
+        }
+        state->priceMemoFn = state->priceFn;
+    }
+
+    // Entries for this time are only ever added, so a probe can stop at the first older one
+    const long mask = PRICE_MEMO_SIZE - 1;
+    long i = (long)((symbol->id * PRICE_MEMO_HASH_MULTIPLIER) >> (64 - PRICE_MEMO_BITS));
+    for (int probes = 0; probes < PRICE_MEMO_SIZE; ++probes, i = (i + 1) & mask) {
+        struct PriceMemoEntry *e = state->priceMemo + i;
+        if (e->time != state->time) {
+            e->symbol.id = symbol->id;
+            e->time      = state->time;
+            e->price     = state->priceFn(symbol, state->time);
+            return e->price;
+        }
+        if (e->symbol.id == symbol->id) return e->price;
+    }
+    // Full of this time's prices
+    return state->priceFn(symbol, state->time);
+}
+
 void printSimState(struct SimState *state) {
     const char *indent = "  ";
     char timeBuffer[128];
@@ -78,7 +120,7 @@ void printSimState(struct SimState *state) {
         printf("%sPositions:\n", indent);
         for (int i = 0; i < state->maxActivePosition; ++i) {
             if (state->positions[i].quantity) {
-                positionWorth = state->positions[i].quantity * state->priceFn(&(state->positions[i].symbol), state->time);
+                positionWorth = state->positions[i].quantity * statePrice(state, &(state->positions[i].symbol));
                 worth += positionWorth;
                 printf("%s%s%-*.*s x %4.d : $%0.2f\n",
                     indent, indent,
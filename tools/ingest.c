@@ -0,0 +1,566 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "args_parser.h"
+#include "display_tools.h"
+#include "load_prices.h"
+
+// Must match PRICE_STORE_FILENAME_FORMATS[0] in src/load_prices.c
+#define STORE_FILENAME_FORMAT "resources/%s_daily_bars.bin"
+#define SYMBOLS_FILENAME "resources/symbols.txt"
+#define CORRUPTED_FILENAME "resources/corrupted_files.txt"
+#define TIME_COL_NAME "Unix Timestamp"
+// A close more than this factor away from the previous one marks the file as corrupted
+#define GARBAGE_THRESH 5
+#define MAX_INGEST_THREADS 64
+
+/**
+ * Structs
+ */
+
+enum IngestStatus {
+    IngestPending,
+    IngestDone,
+    IngestCorrupted,
+    IngestUnreadable
+};
+
+// One file matching one of the patterns, for one symbol
+struct IngestFile {
+    union Symbol symbol;
+    int pattern; // earlier patterns take precedence
+    char *filename;
+};
+
+// The result for one symbol, from the first of its files that ingested cleanly
+struct IngestSymbol {
+    union Symbol symbol;
+    struct IngestFile *files;
+    int numFiles;
+    enum IngestStatus status;
+    time_t start, end;
+};
+
+static struct {
+    int threads;
+} OPTIONS;
+
+static struct IngestSymbol *SYMBOLS = NULL;
+static int NUM_SYMBOLS = 0;
+static _Atomic int NEXT_SYMBOL;
+static pthread_mutex_t PROGRESS_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// Columns rewritten as integers, then as floats, by sanitizing
+static const char *INT_COL_NAMES[]   = {TIME_COL_NAME};
+static const char *FLOAT_COL_NAMES[] = {"Open", "High", "Low", "Close", "Volume"};
+static const int NUM_INT_COL_NAMES   = sizeof(INT_COL_NAMES) / sizeof(*INT_COL_NAMES);
+static const int NUM_FLOAT_COL_NAMES = sizeof(FLOAT_COL_NAMES) / sizeof(*FLOAT_COL_NAMES);
+
+/**
+ * Forward Declarations
+ */
+
+void parseArgs(int argc, char *argv[]);
+int findSymbolFiles(char **patterns, int numPatterns, struct IngestFile **files);
+int readCorruptedSymbols(union Symbol **symbols);
+void *runIngestWorker(void *dummy);
+enum IngestStatus ingestFile(const struct IngestFile *file, time_t *start, time_t *end);
+int sanitizeFile(FILE *in, FILE *out);
+int sanitizeLine(char *line, const int *colTypes, int numCols, FILE *out);
+void formatShortestDouble(char *buf, int bufSize, double value);
+int isCanonical(const char *value, int type);
+int writeSymbolsFile(void);
+int writeCorruptedFile(const union Symbol *previous, int numPrevious);
+int compareIngestFiles(const void *a, const void *b);
+int compareSymbols(const void *a, const void *b);
+
+/**
+ * Main
+ */
+
+int main(int argc, char *argv[]) {
+    parseArgs(argc, argv);
+    if (optind >= argc) {
+        fprintf(stderr, "Must provide at least 1 pattern\n");
+        printHelpMessage();
+        exit(1);
+    }
+    for (int i = optind; i < argc; ++i) {
+        const char *star = strchr(argv[i], '*');
+        if (!star || strchr(star + 1, '*')) {
+            fprintf(stderr, "Every pattern must have exactly 1 \"*\" wildcard: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    printf("Finding files...\n");
+    struct IngestFile *files;
+    int numFiles = findSymbolFiles(argv + optind, argc - optind, &files);
+    union Symbol *corrupted;
+    int numCorrupted = readCorruptedSymbols(&corrupted);
+
+    // Group files by symbol, in order of precedence, leaving out known corrupted symbols
+    qsort(files, numFiles, sizeof(*files), compareIngestFiles);
+    SYMBOLS = malloc(sizeof(*SYMBOLS) * (numFiles ? numFiles : 1));
+    for (int i = 0; i < numFiles; ) {
+        int j = i + 1;
+        while (j < numFiles && files[j].symbol.id == files[i].symbol.id) ++j;
+        if (!bsearch(&files[i].symbol, corrupted, numCorrupted, sizeof(*corrupted), compareSymbols)) {
+            SYMBOLS[NUM_SYMBOLS].symbol.id = files[i].symbol.id;
+            SYMBOLS[NUM_SYMBOLS].files     = files + i;
+            SYMBOLS[NUM_SYMBOLS].numFiles  = j - i;
+            SYMBOLS[NUM_SYMBOLS].status    = IngestPending;
+            ++NUM_SYMBOLS;
+        }
+        i = j;
+    }
+
+    int threads = OPTIONS.threads;
+    if (threads > NUM_SYMBOLS) threads = NUM_SYMBOLS;
+    if (threads > MAX_INGEST_THREADS) threads = MAX_INGEST_THREADS;
+    if (threads < 1) threads = 1;
+    printf("Found %d symbols. Processing on %d threads...\n", NUM_SYMBOLS, threads);
+
+    if (NUM_SYMBOLS) initProgressBar(NUM_SYMBOLS);
+    atomic_init(&NEXT_SYMBOL, 0);
+    pthread_t workers[MAX_INGEST_THREADS];
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(workers + i, NULL, runIngestWorker, NULL)) {
+            fprintf(stderr, "Error creating ingest thread.\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    int done = 0, newlyCorrupted = 0;
+    for (int i = 0; i < NUM_SYMBOLS; ++i) {
+        if (SYMBOLS[i].status == IngestDone) {
+            ++done;
+        } else if (SYMBOLS[i].status == IngestCorrupted) {
+            ++newlyCorrupted;
+        } else {
+            printf("Error reading data files for %.*s\n", SYMBOL_LENGTH, SYMBOLS[i].symbol.name);
+        }
+    }
+    if (!writeSymbolsFile() || !writeCorruptedFile(corrupted, numCorrupted)) {
+        exit(1);
+    }
+    printf("Made symbols file \"%s\" with %d symbols. Found %d newly corrupted files.\n", SYMBOLS_FILENAME, done, newlyCorrupted);
+
+    for (int i = 0; i < numFiles; ++i) {
+        free(files[i].filename);
+    }
+    free(files);
+    free(corrupted);
+    free(SYMBOLS);
+    return 0;
+}
+
+void parseArgs(int argc, char *argv[]) {
+    struct CommandLineArg cla;
+
+    OPTIONS.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    addUsageLine("stock-ingest [options] PATTERN...");
+    addSummary("Prepare a fresh data drop, in one parallel pass over the files matching PATTERN(s).\n"
+        "Scrubs timestamps to be ints and prices to be floats, writes a binary price store for each symbol,\n"
+        "and makes " SYMBOLS_FILENAME ", adding newly corrupted symbols to " CORRUPTED_FILENAME ".\n"
+        "Each PATTERN must contain exactly one \"*\" wildcard, for the location in the path of the symbol.\n"
+        "Earlier patterns have precedence over later ones.\n"
+        "Example: stock-ingest 'resources/*_daily_bars_san.csv'");
+
+    cla.description   = "Use n threads (default: number of processors)";
+    cla.parameter     = 'n';
+    cla.shortName     = 'j';
+    cla.type          = CLA_INT;
+    cla.valuePtr.iptr = &OPTIONS.threads;
+    addArg(&cla);
+
+    parseCommandLineArgs(argc, argv);
+}
+
+/**
+ * Helpers
+ */
+
+/**
+ * Finds every file matching patterns, and the symbol each one is for.
+ * Returns the number of files, leaving a malloc'd array of them in files.
+ */
+int findSymbolFiles(char **patterns, int numPatterns, struct IngestFile **files) {
+    int n = 0, capacity = 1024;
+    *files = malloc(sizeof(**files) * capacity);
+
+    glob_t matches;
+    for (int p = 0; p < numPatterns; ++p) {
+        if (glob(patterns[p], 0, NULL, &matches)) continue;
+        const size_t prefix = strchr(patterns[p], '*') - patterns[p];
+        const size_t suffix = strlen(patterns[p]) - prefix - 1;
+        for (size_t i = 0; i < matches.gl_pathc; ++i) {
+            const char *filename = matches.gl_pathv[i];
+            const size_t length = strlen(filename) - prefix - suffix;
+            if (length < 1 || length > SYMBOL_LENGTH) {
+                fprintf(stderr, "Skipping %s, whose symbol isn't 1 to %d characters\n", filename, SYMBOL_LENGTH);
+                continue;
+            }
+            if (n >= capacity) {
+                capacity *= 2;
+                *files = realloc(*files, sizeof(**files) * capacity);
+            }
+            (*files)[n].symbol.id = 0;
+            memcpy((*files)[n].symbol.name, filename + prefix, length);
+            (*files)[n].pattern  = p;
+            (*files)[n].filename = strdup(filename);
+            ++n;
+        }
+        globfree(&matches);
+    }
+    return n;
+}
+
+/**
+ * Reads the corrupted symbols list, if there is one.
+ * Returns the number of symbols, leaving a malloc'd array of them, sorted, in symbols.
+ */
+int readCorruptedSymbols(union Symbol **symbols) {
+    int n = 0, capacity = 64;
+    *symbols = malloc(sizeof(**symbols) * capacity);
+
+    FILE *fp = fopen(CORRUPTED_FILENAME, "r");
+    if (!fp) return 0;
+    char buf[256];
+    char *front;
+    while (fgets(buf, sizeof(buf), fp)) {
+        for (front = buf; *front && *front != '\n' && *front != '\r'; ++front) ;
+        *front = 0;
+        if (!*buf || strlen(buf) > SYMBOL_LENGTH) continue;
+        if (n >= capacity) {
+            capacity *= 2;
+            *symbols = realloc(*symbols, sizeof(**symbols) * capacity);
+        }
+        (*symbols)[n].id = 0;
+        memcpy((*symbols)[n].name, buf, strlen(buf));
+        ++n;
+    }
+    fclose(fp);
+    qsort(*symbols, n, sizeof(**symbols), compareSymbols);
+    return n;
+}
+
+// Add GCC unused attribute to stop GCC complaining
+// if I don't use this variable in the body.
+void *runIngestWorker(__attribute__ ((unused)) void *dummy) {
+    struct IngestSymbol *s;
+    enum IngestStatus status;
+    int i;
+    while ((i = atomic_fetch_add_explicit(&NEXT_SYMBOL, 1, memory_order_relaxed)) < NUM_SYMBOLS) {
+        s = SYMBOLS + i;
+        // Fall back on later patterns' files if earlier ones are unusable
+        s->status = IngestUnreadable;
+        for (int f = 0; f < s->numFiles && s->status != IngestDone; ++f) {
+            status = ingestFile(s->files + f, &s->start, &s->end);
+            if (status == IngestDone || s->status == IngestUnreadable) {
+                s->status = status;
+            }
+        }
+        pthread_mutex_lock(&PROGRESS_LOCK);
+        updateProgressBar();
+        pthread_mutex_unlock(&PROGRESS_LOCK);
+    }
+    return NULL;
+}
+
+/**
+ * Sanitizes file in place, then parses it exactly as the simulator would
+ * and writes out its binary price store, unless it's corrupted.
+ * The file is only read once; the parse runs over the sanitized copy in memory.
+ */
+enum IngestStatus ingestFile(const struct IngestFile *file, time_t *start, time_t *end) {
+    FILE *in = fopen(file->filename, "r");
+    if (!in) return IngestUnreadable;
+
+    char *text = NULL;
+    size_t textSize = 0;
+    FILE *out = open_memstream(&text, &textSize);
+    int changed = sanitizeFile(in, out);
+    fclose(in);
+    fclose(out);
+
+    char tempName[512];
+    if (changed) {
+        snprintf(tempName, sizeof(tempName), "%s.in-progress", file->filename);
+        FILE *fp = fopen(tempName, "w");
+        int ok = fp && fwrite(text, 1, textSize, fp) == textSize;
+        ok = fp && !fclose(fp) && ok;
+        if (!ok || rename(tempName, file->filename)) {
+            fprintf(stderr, "Cannot write sanitized file %s\n", file->filename);
+            remove(tempName);
+            free(text);
+            return IngestUnreadable;
+        }
+    }
+    // The store records the file as it now stands, so the simulator knows the two match
+    struct stat textStat;
+    if (stat(file->filename, &textStat)) {
+        free(text);
+        return IngestUnreadable;
+    }
+
+    struct Prices p;
+    p.symbol.id = file->symbol.id;
+    p.mapping = NULL;
+    p.packed  = NULL;
+    FILE *fp = fmemopen(text, textSize ? textSize : 1, "r");
+    long rows = (fp ? parseHistoricalPrice(&p, fp) : 0);
+    if (fp) fclose(fp);
+    free(text);
+    if (!rows) {
+        if (fp) free(p.times);
+        return IngestUnreadable;
+    }
+
+    enum IngestStatus status = IngestDone;
+    const long *close = p.bars[BarClose];
+    for (long r = 1; r < rows; ++r) {
+        if (close[r] > GARBAGE_THRESH * close[r - 1] || close[r] * GARBAGE_THRESH < close[r - 1]) {
+            status = IngestCorrupted;
+            break;
+        }
+    }
+    if (status == IngestDone) {
+        char symbolName[SYMBOL_LENGTH + 1];
+        memcpy(symbolName, file->symbol.name, SYMBOL_LENGTH);
+        symbolName[SYMBOL_LENGTH] = 0;
+        snprintf(tempName, sizeof(tempName), STORE_FILENAME_FORMAT, symbolName);
+        if (!writeHistoricalPriceStore(&p, tempName, &textStat)) {
+            fprintf(stderr, "Cannot write price store %s\n", tempName);
+        }
+        *start = p.times[0];
+        *end   = p.times[rows - 1];
+    }
+    free(p.times);
+    return status;
+}
+
+/**
+ * Copies a price file from in to out, rewriting timestamps as ints and prices as floats.
+ * Values that don't parse are left alone.
+ * Returns 1 if anything changed, 0 if out is identical to in.
+ */
+int sanitizeFile(FILE *in, FILE *out) {
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    int changed = 0;
+
+    // Find the column types from the header row
+    int numCols = 0;
+    int *colTypes = NULL;
+    if (getline(&line, &lineCapacity, in) > 0) {
+        changed |= sanitizeLine(line, NULL, 0, out);
+        char *header = line;
+        while (*header == ' ' || *header == '\t') ++header;
+        for (char *back = header, *front = header; ; back = ++front) {
+            while (*front && *front != ',') ++front;
+            const int last = !*front;
+            *front = 0;
+            colTypes = realloc(colTypes, sizeof(int) * (numCols + 1));
+            colTypes[numCols] = 0;
+            for (int c = 0; c < NUM_INT_COL_NAMES; ++c) {
+                if (!strcmp(back, INT_COL_NAMES[c])) colTypes[numCols] = 'i';
+            }
+            for (int c = 0; c < NUM_FLOAT_COL_NAMES; ++c) {
+                if (!strcmp(back, FLOAT_COL_NAMES[c])) colTypes[numCols] = 'f';
+            }
+            ++numCols;
+            if (last) break;
+        }
+    }
+
+    while (getline(&line, &lineCapacity, in) > 0) {
+        changed |= sanitizeLine(line, colTypes, numCols, out);
+    }
+    free(line);
+    free(colTypes);
+    return changed;
+}
+
+/**
+ * Writes line to out, with surrounding whitespace removed and each value in a column
+ * of type 'i' or 'f' rewritten. colTypes may be NULL to only trim the line.
+ * Leaves line trimmed, with its values split by nulls.
+ * Returns 1 if what was written differs from the original line.
+ */
+int sanitizeLine(char *line, const int *colTypes, int numCols, FILE *out) {
+    char *end = line + strlen(line);
+    int changed = (end == line || end[-1] != '\n');
+    if (!changed) --end;
+    while (end > line && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) --end, changed = 1;
+    *end = 0;
+    while (*line == ' ' || *line == '\t') ++line, changed = 1;
+
+    char formatted[64];
+    char *parseEnd;
+    double value;
+    int col = 0;
+    for (char *back = line, *front = line; ; back = ++front, ++col) {
+        while (*front && *front != ',') ++front;
+        const int last = !*front;
+        *front = 0;
+        if (col) fputc(',', out);
+
+        const int type = (colTypes && col < numCols ? colTypes[col] : 0);
+        const int rewrite = type && !isCanonical(back, type);
+        if (rewrite) value = strtod(back, &parseEnd);
+        // Leave anything that doesn't read as a finite number, in range for its type, as it was
+        if (rewrite && parseEnd != back && !*parseEnd && isfinite(value) &&
+            (type != 'i' || (value >= (double)LONG_MIN && value < -(double)LONG_MIN))) {
+            if (type == 'i') {
+                snprintf(formatted, sizeof(formatted), "%ld", (long)value);
+            } else {
+                formatShortestDouble(formatted, sizeof(formatted), value);
+            }
+            changed |= strcmp(formatted, back) != 0;
+            fputs(formatted, out);
+        } else {
+            fputs(back, out);
+        }
+        if (last) break;
+    }
+    if (!colTypes) {
+        // Put the header back together for the caller to split again
+        for (char *c = line; c < end; ++c) {
+            if (!*c) *c = ',';
+        }
+    }
+    fputc('\n', out);
+    return changed;
+}
+
+/**
+ * Formats value with the fewest digits that read back exactly,
+ * always showing a decimal point, e.g. 12.0 or 0.1 or 1e+16.
+ */
+void formatShortestDouble(char *buf, int bufSize, double value) {
+    int precision;
+    for (precision = 1; precision < 17; ++precision) {
+        snprintf(buf, bufSize, "%.*e", precision - 1, value);
+        if (strtod(buf, NULL) == value) break;
+    }
+    snprintf(buf, bufSize, "%.*e", precision - 1, value);
+    const char *e = strchr(buf, 'e');
+    if (!e) return; // inf or nan
+    const int exponent = atoi(e + 1);
+    if (exponent < -4 || exponent >= 16) return;
+
+    const int decimals = precision - 1 - exponent;
+    snprintf(buf, bufSize, "%.*f", (decimals > 0 ? decimals : 0), value);
+    if (!strchr(buf, '.')) strncat(buf, ".0", bufSize - strlen(buf) - 1);
+}
+
+/**
+ * Returns 1 if value is already exactly what sanitizing would write for a column of type,
+ * so the much slower round trip through formatting can be skipped.
+ * Decimals of up to 15 significant digits are the shortest that read back to the same double.
+ */
+int isCanonical(const char *value, int type) {
+    const char *c = value;
+    if (*c == '-') ++c;
+    const char *integer = c;
+    if (*c == '0') {
+        ++c;
+    } else {
+        while (*c >= '0' && *c <= '9') ++c;
+    }
+    int digits = (int)(c - integer);
+    if (!digits) return 0;
+    if (type == 'i') return !*c && digits <= 15;
+
+    if (*c++ != '.') return 0;
+    const char *fraction = c;
+    while (*c >= '0' && *c <= '9') ++c;
+    if (*c || c == fraction) return 0;
+    // Trailing zeros are only written for whole numbers, as one zero
+    if (c[-1] == '0' && c - fraction > 1) return 0;
+    if (*integer == '0') {
+        // Small values are written in exponent form, below 1e-4
+        while (*fraction == '0' && fraction < c - 1) ++fraction;
+        if (fraction - (integer + 2) > 3) return 0;
+        digits = 0;
+    }
+    return digits + (int)(c - fraction) <= 15;
+}
+
+int writeSymbolsFile(void) {
+    char tempName[512];
+    snprintf(tempName, sizeof(tempName), "%s.in-progress", SYMBOLS_FILENAME);
+    FILE *fp = fopen(tempName, "w");
+    if (!fp) {
+        fprintf(stderr, "Cannot write symbols file %s\n", tempName);
+        return 0;
+    }
+    int ok = fprintf(fp, "Symbol,Start Time,End Time\n") > 0;
+    for (int i = 0; i < NUM_SYMBOLS && ok; ++i) {
+        if (SYMBOLS[i].status != IngestDone) continue;
+        ok = fprintf(fp, "%.*s,%ld,%ld\n", SYMBOL_LENGTH, SYMBOLS[i].symbol.name, SYMBOLS[i].start, SYMBOLS[i].end) > 0;
+    }
+    ok = !fclose(fp) && ok;
+    if (!ok || rename(tempName, SYMBOLS_FILENAME)) {
+        fprintf(stderr, "Cannot write symbols file %s\n", SYMBOLS_FILENAME);
+        remove(tempName);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Rewrites the corrupted symbols list as the previous list plus every newly corrupted symbol.
+ */
+int writeCorruptedFile(const union Symbol *previous, int numPrevious) {
+    union Symbol *all = malloc(sizeof(*all) * (numPrevious + NUM_SYMBOLS + 1));
+    int n = numPrevious;
+    memcpy(all, previous, sizeof(*all) * numPrevious);
+    for (int i = 0; i < NUM_SYMBOLS; ++i) {
+        if (SYMBOLS[i].status == IngestCorrupted) all[n++].id = SYMBOLS[i].symbol.id;
+    }
+    if (n == numPrevious) {
+        free(all);
+        return 1;
+    }
+    qsort(all, n, sizeof(*all), compareSymbols);
+
+    char tempName[512];
+    snprintf(tempName, sizeof(tempName), "%s.in-progress", CORRUPTED_FILENAME);
+    FILE *fp = fopen(tempName, "w");
+    int ok = (fp != NULL);
+    for (int i = 0; i < n && ok; ++i) {
+        ok = fprintf(fp, "%.*s\n", SYMBOL_LENGTH, all[i].name) > 0;
+    }
+    ok = fp && !fclose(fp) && ok;
+    free(all);
+    if (!ok || rename(tempName, CORRUPTED_FILENAME)) {
+        fprintf(stderr, "Cannot write corrupted files list %s\n", CORRUPTED_FILENAME);
+        remove(tempName);
+        return 0;
+    }
+    return 1;
+}
+
+int compareIngestFiles(const void *a, const void *b) {
+    const struct IngestFile *x = a, *y = b;
+    int bySymbol = compareSymbols(&x->symbol, &y->symbol);
+    return (bySymbol ? bySymbol : x->pattern - y->pattern);
+}
+
+int compareSymbols(const void *a, const void *b) {
+    return strncmp(((const union Symbol *)a)->name, ((const union Symbol *)b)->name, SYMBOL_LENGTH);
+}